@@ -0,0 +1,450 @@
+// Created by Unium on 18.10.26
+
+// rendering without a terminal, one job from the command line or many from
+// a manifest. a manifest has one job per line with the same options as the
+// command line, words with spaces in quotes and # starting a comment. the
+// jobs run in parallel on the pool, one thread each. every formula is
+// compiled once up front, and the frames jobs draw into are handed from
+// one job to the next. what a job draws doesn't depend on the jobs before
+// it, so the files are the same for any number of threads. --eval skips
+// the drawing and writes the samples of one formula as text or doubles
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "image.h"
+#include "maths.h"
+#include "parser.h"
+#include "pool.h"
+#include "raster.h"
+#include "types.h"
+#include "vector.h"
+
+#define cellW 6 // pixels of a cell of a text export
+#define cellH 12
+#define mmWords 64 // per manifest line
+#define evalChunk 65536 // samples a task of --eval evaluates and formats
+#define csvLine 52      // longest "x,y\n" of two %.17g and the '\0'
+
+typedef struct {
+  const char *out;
+  int w, h; // pixels
+  PView v;
+  int nf;
+  const char *f[mmFuncs];
+  const char *err; // why it failed, NULL when it didn't
+  int line;        // of the manifest
+  double ms;
+} BJob;
+
+// a formula and what it compiled to, sorted by formula
+typedef struct {
+  const char *f;
+  Prog *pg;
+} BProg;
+
+typedef struct {
+  BJob *jobs;
+  BProg *progs;
+  int nprogs;
+  PFrame *frames; // one per thread, idle lists those no job is using
+  int *idle, nidle;
+  pthread_mutex_t lock;
+} Batch;
+
+static double now_ms(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// one job from its options, NULL or what was wrong with them
+static const char *parse_job(int argc, char **argv, BJob *j) {
+  *j = (BJob){.w = 480, .h = 240, .v = {-10, 10, -10, 10, 1, 1}};
+  for (int i = 0; i < argc; i += 2) {
+    const char *a = argv[i], *n = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!n)
+      return "option without a value";
+    if (strcmp(a, "--render") == 0) {
+      j->out = n;
+    } else if (strcmp(a, "--size") == 0) {
+      if (sscanf(n, "%dx%d", &j->w, &j->h) != 2 || j->w < cellW ||
+          j->h < cellH)
+        return "bad --size";
+    } else if (strcmp(a, "--x") == 0) {
+      if (sscanf(n, "%lf:%lf", &j->v.mX, &j->v.mmX) != 2 ||
+          !(j->v.mX < j->v.mmX))
+        return "bad --x";
+    } else if (strcmp(a, "--y") == 0) {
+      if (sscanf(n, "%lf:%lf", &j->v.mY, &j->v.mmY) != 2 ||
+          !(j->v.mY < j->v.mmY))
+        return "bad --y";
+      j->v.autoScale = 0;
+    } else if (strcmp(a, "-f") == 0) {
+      if (j->nf == mmFuncs)
+        return "too many -f";
+      if (strlen(n) >= mmFormulaLen)
+        return "formula too long";
+      j->f[j->nf++] = n;
+    } else {
+      return "unknown option";
+    }
+  }
+  if (!j->out)
+    return "no --render file";
+  if (!j->nf)
+    return "no -f formula";
+  return NULL;
+}
+
+// splits s in place into at most mm words, -1 for more or an unclosed quote
+static int split(char *s, char **w, int mm) {
+  int n = 0;
+  for (;;) {
+    while (isspace((unsigned char)*s))
+      s++;
+    if (!*s || *s == '#')
+      return n;
+    if (n == mm)
+      return -1;
+    char q = *s == '"' || *s == '\'' ? *s++ : 0;
+    w[n++] = s;
+    while (*s && (q ? *s != q : !isspace((unsigned char)*s)))
+      s++;
+    if (q && !*s)
+      return -1;
+    if (*s)
+      *s++ = '\0';
+  }
+}
+
+// the jobs of a manifest, their words pointing into *text. -1 when it
+// can't be read, a bad line only fails its own job
+static int read_manifest(const char *name, char **text, BJob **jobs) {
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return -1;
+  size_t cap = 1 << 16, len = 0;
+  char *t = malloc(cap);
+  for (size_t got; t && (got = fread(t + len, 1, cap - len - 1, f)) > 0;) {
+    len += got;
+    char *nt = len + 1 == cap ? realloc(t, cap *= 2) : t;
+    if (!nt)
+      free(t);
+    t = nt;
+  }
+  fclose(f);
+  if (!t)
+    return -1;
+  t[len] = '\0';
+  *text = t;
+
+  int n = 0, mm = 0, line_no = 0;
+  for (char *line = t, *next; line; line = next) {
+    line_no++;
+    next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+    char *w[mmWords];
+    int nw = split(line, w, mmWords);
+    if (nw == 0)
+      continue;
+    if (n == mm) {
+      BJob *nj = realloc(*jobs, (mm = mm ? mm * 2 : 64) * sizeof(BJob));
+      if (!nj)
+        return -1;
+      *jobs = nj;
+    }
+    BJob *j = &(*jobs)[n++];
+    const char *err = nw < 0 ? "bad quoting" : parse_job(nw, w, j);
+    if (err)
+      *j = (BJob){.err = err};
+    j->line = line_no;
+  }
+  return n;
+}
+
+static int by_formula(const void *a, const void *b) {
+  return strcmp(((const BProg *)a)->f, ((const BProg *)b)->f);
+}
+
+// every formula of the jobs compiled once, sorted for bsearch
+static int compile_all(Batch *b, int njobs) {
+  int n = 0;
+  for (int i = 0; i < njobs; i++)
+    n += b->jobs[i].nf;
+  b->progs = malloc((n ? n : 1) * sizeof(BProg));
+  if (!b->progs)
+    return -1;
+  n = 0;
+  for (int i = 0; i < njobs; i++)
+    for (int k = 0; k < b->jobs[i].nf; k++)
+      b->progs[n++] = (BProg){b->jobs[i].f[k], NULL};
+  qsort(b->progs, n, sizeof(BProg), by_formula);
+  int u = 0;
+  for (int i = 0; i < n; i++) {
+    if (u && strcmp(b->progs[u - 1].f, b->progs[i].f) == 0)
+      continue;
+    b->progs[u] = b->progs[i];
+    b->progs[u].pg = p_compile(b->progs[u].f);
+    p_jit(b->progs[u].pg);
+    u++;
+  }
+  b->nprogs = u;
+  return 0;
+}
+
+static void run_job(void *arg, int i) {
+  Batch *b = arg;
+  BJob *j = &b->jobs[i];
+  if (j->err)
+    return;
+  double t0 = now_ms();
+
+  PScene s = {.v = j->v, .w = j->w / cellW, .h = j->h / cellH};
+  for (int k = 0; k < j->nf; k++) {
+    BProg key = {j->f[k], NULL};
+    BProg *c = bsearch(&key, b->progs, b->nprogs, sizeof(BProg), by_formula);
+    if (!c->pg || c->pg->root < 0) {
+      j->err = "formula does not compile";
+      return;
+    }
+    f_add(&s.funcs, j->f[k]);
+    s.funcs.functions[k].prog = c->pg;
+  }
+  if (s.v.autoScale)
+    autoscale(&s.v, &s.funcs);
+
+  // images and pages are drawn at the size given
+  const char *dot = strrchr(j->out, '.');
+  int (*page)(const char *, const PScene *, int, int) =
+      !dot                       ? NULL
+      : strcmp(dot, ".png") == 0 ? export_png
+      : strcmp(dot, ".svg") == 0 ? export_svg
+      : strcmp(dot, ".pdf") == 0 ? export_pdf
+                                 : NULL;
+  if (page) {
+    if (page(j->out, &s, j->w, j->h) != 0)
+      j->err = "cannot write";
+    j->ms = now_ms() - t0;
+    return;
+  }
+  // text is in cells, the size rounded down to them
+  j->w = s.w * cellW;
+  j->h = s.h * cellH;
+  pthread_mutex_lock(&b->lock);
+  PFrame *fb = &b->frames[b->idle[--b->nidle]];
+  pthread_mutex_unlock(&b->lock);
+  d_frame_forget(fb);
+  if (d_render(fb, &s) != 0)
+    j->err = "out of memory";
+  else if (export_text(j->out, fb) != 0)
+    j->err = "cannot write";
+  pthread_mutex_lock(&b->lock);
+  b->idle[b->nidle++] = (int)(fb - b->frames);
+  pthread_mutex_unlock(&b->lock);
+  j->ms = now_ms() - t0;
+}
+
+// argv starts at --render or --manifest. prints a line per job and
+// returns 1 when any failed
+int b_run(int argc, char **argv) {
+  BJob *jobs = NULL;
+  char *text = NULL;
+  int njobs = 1;
+  if (strcmp(argv[0], "--manifest") == 0) {
+    njobs = argc == 2 ? read_manifest(argv[1], &text, &jobs) : -1;
+    if (njobs < 0) {
+      fprintf(stderr, "cannot read manifest\n");
+      free(jobs);
+      free(text);
+      return 2;
+    }
+  } else {
+    jobs = malloc(sizeof(BJob));
+    const char *err = jobs ? parse_job(argc, argv, jobs) : "out of memory";
+    if (err) {
+      fprintf(stderr, "%s\n", err);
+      free(jobs);
+      return 2;
+    }
+  }
+
+  int threads = t_threads();
+  Batch b = {jobs, NULL, 0, calloc(threads, sizeof(PFrame)),
+             malloc(threads * sizeof(int)), threads,
+             PTHREAD_MUTEX_INITIALIZER};
+  int failed = 0;
+  double t0 = now_ms();
+  if (!b.frames || !b.idle || compile_all(&b, njobs) != 0) {
+    fprintf(stderr, "out of memory\n");
+    failed = njobs;
+  } else {
+    for (int i = 0; i < threads; i++)
+      b.idle[i] = i;
+    t_for(njobs, run_job, &b);
+    for (int i = 0; i < njobs; i++) {
+      BJob *j = &jobs[i];
+      if (j->err && !j->out)
+        printf("line %-27d  %s\n", j->line, j->err);
+      else if (j->err)
+        printf("%-32s  %s\n", j->out, j->err);
+      else
+        printf("%-32s  %dx%d  %d f  %.2f ms\n", j->out, j->w, j->h, j->nf,
+               j->ms);
+      failed += j->err != NULL;
+    }
+    printf("%d jobs, %d failed, %.1f ms on %d threads\n", njobs, failed,
+           now_ms() - t0, threads);
+  }
+
+  for (int i = 0; i < b.nprogs; i++)
+    p_free(b.progs[i].pg);
+  for (int i = 0; b.frames && i < threads; i++)
+    d_frame_free(&b.frames[i]);
+  free(b.progs);
+  free(b.frames);
+  free(b.idle);
+  free(jobs);
+  free(text);
+  return failed ? 1 : 0;
+}
+
+typedef struct {
+  const Prog *pg;
+  double a, b;
+  long long n, first; // samples in all, the first of this round
+  int bin;
+  double *xs, *ys; // evalChunk per task
+  char *out;       // evalChunk * csvLine per task
+  size_t *len;
+} BEval;
+
+static char *put_le(char *o, double d) {
+  uint64_t u;
+  memcpy(&u, &d, sizeof u);
+  for (int k = 0; k < 8; k++)
+    *o++ = (char)(u >> 8 * k);
+  return o;
+}
+
+// one chunk of the round, evaluated and formatted into the task's own
+// buffers so the caller writes them out in order
+static void eval_chunk(void *arg, int t) {
+  BEval *e = arg;
+  long long i0 = e->first + (long long)t * evalChunk;
+  int m = e->n - i0 < evalChunk ? (int)(e->n - i0) : evalChunk;
+  double *xs = e->xs + (size_t)t * evalChunk;
+  double *ys = e->ys + (size_t)t * evalChunk;
+  // the ends are exact, n samples take n - 1 steps
+  for (int j = 0; j < m; j++)
+    xs[j] = e->n > 1 ? e->a + (e->b - e->a) * (double)(i0 + j) / (e->n - 1)
+                     : e->a;
+  p_batch(e->pg, xs, ys, m);
+  char *o = e->out + (size_t)t * evalChunk * csvLine, *p = o;
+  for (int j = 0; j < m; j++)
+    if (e->bin)
+      p = put_le(put_le(p, xs[j]), ys[j]);
+    else
+      p += snprintf(p, csvLine, "%.17g,%.17g\n", xs[j], ys[j]);
+  e->len[t] = (size_t)(p - o);
+}
+
+// the options of --eval, NULL or what was wrong with them
+static const char *parse_eval(int argc, char **argv, BEval *e,
+                              const char **path) {
+  *e = (BEval){.a = -10, .b = 10, .n = 1000};
+  for (int i = 0; i < argc; i += 2) {
+    const char *a = argv[i], *n = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!n)
+      return "option without a value";
+    if (strcmp(a, "--x") == 0) {
+      if (sscanf(n, "%lf:%lf", &e->a, &e->b) != 2 || !isfinite(e->a) ||
+          !isfinite(e->b))
+        return "bad --x";
+    } else if (strcmp(a, "--n") == 0) {
+      if (sscanf(n, "%lld", &e->n) != 1 || e->n < 1)
+        return "bad --n";
+    } else if (strcmp(a, "--format") == 0) {
+      if (strcmp(n, "csv") != 0 && strcmp(n, "bin") != 0)
+        return "bad --format";
+      e->bin = strcmp(n, "bin") == 0;
+    } else if (strcmp(a, "--out") == 0) {
+      *path = n;
+    } else {
+      return "unknown option";
+    }
+  }
+  return NULL;
+}
+
+// argv starts at --eval. writes x,y lines (csv) or pairs of little-endian
+// doubles (bin) to stdout or --out, a round of one chunk per thread at a
+// time so memory stays the same for any n. the rate goes to stderr
+int b_eval(int argc, char **argv) {
+  const char *path = NULL;
+  BEval e;
+  const char *err =
+      argc < 2 ? "no formula" : parse_eval(argc - 2, argv + 2, &e, &path);
+  Prog *pg = err ? NULL : p_compile(argv[1]);
+  if (!err && (!pg || pg->root < 0))
+    err = "formula does not compile";
+  if (err) {
+    fprintf(stderr, "%s\n", err);
+    p_free(pg);
+    return 2;
+  }
+  p_jit(pg);
+  e.pg = pg;
+
+  FILE *o = path ? fopen(path, "wb") : stdout;
+  int threads = t_threads();
+  e.xs = malloc((size_t)threads * evalChunk * sizeof(double));
+  e.ys = malloc((size_t)threads * evalChunk * sizeof(double));
+  e.out = malloc((size_t)threads * evalChunk * csvLine);
+  e.len = malloc(threads * sizeof(size_t));
+  int r = 0;
+  if (!o) {
+    fprintf(stderr, "cannot write %s\n", path);
+    r = 1;
+  } else if (!e.xs || !e.ys || !e.out || !e.len) {
+    fprintf(stderr, "out of memory\n");
+    r = 1;
+  } else {
+    double t0 = now_ms();
+    for (e.first = 0; e.first < e.n && !r;) {
+      long long left = (e.n - e.first + evalChunk - 1) / evalChunk;
+      int tasks = left < threads ? (int)left : threads;
+      t_for(tasks, eval_chunk, &e);
+      for (int t = 0; t < tasks && !r; t++)
+        r = fwrite(e.out + (size_t)t * evalChunk * csvLine, 1, e.len[t], o) !=
+            e.len[t];
+      e.first += (long long)tasks * evalChunk;
+    }
+    if (fflush(o) != 0 || r) {
+      fprintf(stderr, "cannot write %s\n", path ? path : "stdout");
+      r = 1;
+    } else {
+      double ms = now_ms() - t0;
+      fprintf(stderr, "%lld samples, %.1f ms, %.3g samples/s on %d threads\n",
+              e.n, ms, e.n / (ms > 0 ? ms / 1e3 : 1e-9), threads);
+    }
+  }
+  if (o && path && fclose(o) != 0 && !r) {
+    fprintf(stderr, "cannot write %s\n", path);
+    r = 1;
+  }
+  free(e.xs);
+  free(e.ys);
+  free(e.out);
+  free(e.len);
+  p_free(pg);
+  return r;
+}
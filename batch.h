@@ -0,0 +1,11 @@
+// Created by Unium on 18.10.26
+
+#ifndef BATCH_H
+#define BATCH_H
+
+// renders the jobs of --render ... or --manifest FILE without a terminal
+int b_run(int argc, char **argv);
+// writes the samples of --eval FORMULA ... to stdout or a file
+int b_eval(int argc, char **argv);
+
+#endif // !BATCH_H
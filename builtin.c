@@ -0,0 +1,81 @@
+// Created by Unium on 18.10.26
+
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parser.h"
+#include "types.h"
+
+#define bSlots 64 // power of two, kept at least twice the table size
+
+// functions sit at their op so evaluation can index straight in, constants
+// follow after oCOUNT. slots without a name are operators
+const Builtin p_builtins[] = {
+    [oASIN] = {{"asin", "asin(x)", "Arcsine"}, oASIN, 1, 0, dUNIT, asin},
+    [oACOS] = {{"acos", "acos(x)", "Arccosine"}, oACOS, 1, 0, dUNIT, acos},
+    [oATAN] = {{"atan", "atan(x)", "Arctangent"}, oATAN, 1, 0, dALL, atan},
+    [oSINH] = {{"sinh", "sinh(x)", "Hyp. sine"}, oSINH, 1, 0, dALL, sinh},
+    [oCOSH] = {{"cosh", "cosh(x)", "Hyp. cosine"}, oCOSH, 1, 0, dALL, cosh},
+    [oTANH] = {{"tanh", "tanh(x)", "Hyp. tangent"}, oTANH, 1, 0, dALL, tanh},
+    [oSIN] = {{"sin", "sin(x)", "Sine"}, oSIN, 1, 0, dALL, sin},
+    [oCOS] = {{"cos", "cos(x)", "Cosine"}, oCOS, 1, 0, dALL, cos},
+    [oTAN] = {{"tan", "tan(x)", "Tangent"}, oTAN, 1, 0, dALL, tan},
+    [oEXP] = {{"exp", "exp(x)", "e^x"}, oEXP, 1, 0, dALL, exp},
+    [oSQRT] = {{"sqrt", "sqrt(x)", "Square root"}, oSQRT, 1, 0, dNONNEG, sqrt},
+    [oLN] = {{"ln", "ln(x)", "Natural log"}, oLN, 1, 0, dPOS, log},
+    [oLOG] = {{"log", "log(x)", "Base 10 log"}, oLOG, 1, 0, dPOS, log10},
+    [oABS] = {{"abs", "abs(x)", "Absolute value"}, oABS, 1, 0, dALL, fabs},
+    [oFLOOR] = {{"floor", "floor(x)", "Round down"}, oFLOOR, 1, 0, dALL, floor},
+    [oCEIL] = {{"ceil", "ceil(x)", "Round up"}, oCEIL, 1, 0, dALL, ceil},
+    [oCOUNT] = {{"pi", "pi", "3.14159..."}, oNUM, 0, M_PI, dALL, NULL},
+    [oCOUNT + 1] = {{"e", "e", "2.71828..."}, oNUM, 0, M_E, dALL, NULL},
+};
+
+const int p_nbuiltins = sizeof(p_builtins) / sizeof(p_builtins[0]);
+
+// open addressed, slots hold index + 1. built once on first use, which
+// may come from several threads parsing at the same time
+static unsigned char slots[bSlots];
+static pthread_once_t built = PTHREAD_ONCE_INIT;
+
+static uint32_t hash(const char *s, int len) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < len; i++)
+    h = (h ^ (unsigned char)tolower((unsigned char)s[i])) * 16777619u;
+  return h;
+}
+
+static void build(void) {
+  for (int i = 0; i < p_nbuiltins; i++) {
+    const Builtin *b = &p_builtins[i];
+    if (!b->def.c)
+      continue;
+    uint32_t h = hash(b->def.c, strlen(b->def.c));
+    while (slots[h & (bSlots - 1)])
+      h++;
+    slots[h & (bSlots - 1)] = i + 1;
+  }
+}
+
+const Builtin *p_lookup(const char *s, int len) {
+  pthread_once(&built, build);
+  for (uint32_t h = hash(s, len);; h++) {
+    int i = slots[h & (bSlots - 1)];
+    if (!i)
+      return NULL;
+    const char *n = p_builtins[i - 1].def.c;
+    int k = 0;
+    while (k < len && n[k] && tolower((unsigned char)s[k]) == n[k])
+      k++;
+    if (k == len && !n[k])
+      return &p_builtins[i - 1];
+  }
+}
+
+const Builtin *p_fn(Op op) {
+  return op >= 0 && op < oCOUNT && p_builtins[op].def.c ? &p_builtins[op]
+                                                         : NULL;
+}
@@ -0,0 +1,151 @@
+// Created by Unium on 18.10.26
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "types.h"
+
+static int num(Prog *pg, double v) { return p_node(pg, oNUM, -1, -1, v); }
+
+static int zero(const Prog *pg, int n) {
+  return pg->nodes[n].op == oNUM && pg->nodes[n].v == 0;
+}
+
+static int f1(Prog *pg, Op op, int a) {
+  return a < 0 ? -1 : p_fold(pg, op, a, -1, 0);
+}
+
+static int f2(Prog *pg, Op op, int a, int b) {
+  return a < 0 || b < 0 ? -1 : p_fold(pg, op, a, b, 0);
+}
+
+// a term whose derivative factor is exactly 0 is dropped outright. the
+// terms that remain still go through the operand, so its domain survives
+static int dmul(Prog *pg, int a, int b) {
+  if (a < 0 || b < 0)
+    return -1;
+  if (zero(pg, a) || zero(pg, b))
+    return num(pg, 0);
+  return p_fold(pg, oMUL, a, b, 0);
+}
+
+static int dadd(Prog *pg, Op op, int a, int b) {
+  if (a < 0 || b < 0)
+    return -1;
+  if (zero(pg, b))
+    return a;
+  if (zero(pg, a))
+    return op == oADD ? b : p_fold(pg, oNEG, b, -1, 0);
+  return p_fold(pg, op, a, b, 0);
+}
+
+static int sq(Prog *pg, int a) { return f2(pg, oPOW, a, num(pg, 2)); }
+
+// derivative of node n, given those of its children in d
+static int dnode(Prog *pg, int n, const int *d) {
+  CNode nd = pg->nodes[n];
+  int u = nd.a, v = nd.b;
+  int du = u >= 0 ? d[u] : -1, dv = v >= 0 ? d[v] : -1;
+
+  switch (nd.op) {
+  case oNUM:
+    return num(pg, 0);
+  case oX:
+    return num(pg, 1);
+  case oNEG:
+    return f1(pg, oNEG, du);
+  case oADD:
+  case oSUB:
+    return dadd(pg, nd.op, du, dv);
+  case oMUL:
+    return dadd(pg, oADD, dmul(pg, du, v), dmul(pg, u, dv));
+  case oDIV:
+    // (u' - (u/v) v') / v, the same as (u'v - uv') / v^2 without squaring v
+    return f2(pg, oDIV, dadd(pg, oSUB, du, dmul(pg, n, dv)), v);
+  case oMOD:
+    // u % v = u - v*q with q = (u - u%v)/v constant between the jumps
+    return dadd(pg, oSUB, du,
+                dmul(pg, dv, f2(pg, oDIV, f2(pg, oSUB, u, n), v)));
+  case oPOW:
+    if (zero(pg, dv)) {
+      int p = f2(pg, oPOW, u, f2(pg, oSUB, v, num(pg, 1)));
+      return dmul(pg, dmul(pg, v, p), du);
+    }
+    // u^v (v' ln u + v u'/u)
+    return dmul(pg, n,
+                dadd(pg, oADD, dmul(pg, dv, f1(pg, oLN, u)),
+                     f2(pg, oDIV, dmul(pg, v, du), u)));
+  case oPOWI:
+    return dmul(pg, dmul(pg, num(pg, nd.v), f2(pg, oPOW, u, num(pg, nd.v - 1))),
+                du);
+  case oFACT:
+  case oFLOOR:
+  case oCEIL:
+    // flat between the jumps, 0*n keeps the NaNs of n
+    return f2(pg, oMUL, num(pg, 0), n);
+  case oABS:
+    return dmul(pg, f2(pg, oDIV, u, n), du);
+  case oSQRT:
+    return f2(pg, oDIV, du, f2(pg, oMUL, num(pg, 2), n));
+  case oEXP:
+    return dmul(pg, n, du);
+  case oLN:
+    return f2(pg, oDIV, du, u);
+  case oLOG:
+    return f2(pg, oDIV, du, f2(pg, oMUL, u, f1(pg, oLN, num(pg, 10))));
+  case oSIN:
+    return dmul(pg, f1(pg, oCOS, u), du);
+  case oCOS:
+    return f1(pg, oNEG, dmul(pg, f1(pg, oSIN, u), du));
+  case oTAN:
+    return f2(pg, oDIV, du, sq(pg, f1(pg, oCOS, u)));
+  case oASIN:
+  case oACOS: {
+    int r = f2(pg, oDIV, du,
+               f1(pg, oSQRT, f2(pg, oSUB, num(pg, 1), sq(pg, u))));
+    return nd.op == oASIN ? r : f1(pg, oNEG, r);
+  }
+  case oATAN:
+    return f2(pg, oDIV, du, f2(pg, oADD, num(pg, 1), sq(pg, u)));
+  case oSINH:
+    return dmul(pg, f1(pg, oCOSH, u), du);
+  case oCOSH:
+    return dmul(pg, f1(pg, oSINH, u), du);
+  case oTANH:
+    return f2(pg, oDIV, du, sq(pg, f1(pg, oCOSH, u)));
+  default:
+    return -1;
+  }
+}
+
+// d/dx of a compiled formula as a new, simplified and emitted program.
+// returns NULL only when out of memory
+Prog *p_deriv(const Prog *pg) {
+  Prog *out = calloc(1, sizeof(Prog));
+  if (!out)
+    return NULL;
+  out->root = -1;
+  if (!pg || pg->root < 0)
+    return out;
+
+  // the derivative refers back to f's own subtrees, so they come first and
+  // keep their indices
+  int *d = malloc(pg->n_nodes * sizeof(int));
+  int ok = d != NULL;
+  for (int i = 0; ok && i < pg->n_nodes; i++)
+    ok = p_node(out, pg->nodes[i].op, pg->nodes[i].a, pg->nodes[i].b,
+                pg->nodes[i].v) >= 0;
+  for (int i = 0; ok && i < pg->n_nodes; i++)
+    ok = (d[i] = dnode(out, i, d)) >= 0;
+  if (!ok) {
+    free(d);
+    p_free(out);
+    return NULL;
+  }
+  out->root = d[pg->root];
+  free(d);
+  p_optimize(out);
+  p_emit(out);
+  return out;
+}
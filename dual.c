@@ -0,0 +1,173 @@
+// Created by Unium on 18.10.26
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "types.h"
+
+#define pBlock 64
+
+// g(u) from g's value y and its derivatives g1, g2 at u.v
+static inline Dual chain(Dual u, double y, double g1, double g2) {
+  return (Dual){y, g1 * u.d, g2 * u.d * u.d + g1 * u.dd};
+}
+
+// one op on dual numbers. the value goes through p_op so it matches p_run
+// bit for bit. floor, ceil and factorial are flat (derivatives 0), abs has
+// slope 0 at 0 and fmod is treated as a - trunc(a/b)*b with the quotient
+// held constant
+static Dual dop(Op op, Dual a, Dual b, double imm, int *e) {
+  int bin = op >= oADD && op <= oPOW;
+  double y = p_op(op, a.v, bin ? b.v : imm, e);
+
+  switch (op) {
+  case oADD:
+    return (Dual){y, a.d + b.d, a.dd + b.dd};
+  case oSUB:
+    return (Dual){y, a.d - b.d, a.dd - b.dd};
+  case oMUL:
+    return (Dual){y, a.d * b.v + a.v * b.d,
+                  a.dd * b.v + 2 * a.d * b.d + a.v * b.dd};
+  case oDIV: {
+    double d = (a.d - y * b.d) / b.v;
+    return (Dual){y, d, (a.dd - 2 * d * b.d - y * b.dd) / b.v};
+  }
+  case oMOD: {
+    double k = trunc(a.v / b.v);
+    return (Dual){y, a.d - k * b.d, a.dd - k * b.dd};
+  }
+  case oPOW: {
+    if (b.d == 0 && b.dd == 0)
+      return chain(a, y, b.v * pow(a.v, b.v - 1),
+                   b.v * (b.v - 1) * pow(a.v, b.v - 2));
+    // y = exp(w), w = b ln a
+    double l = log(a.v), r = a.d / a.v;
+    double w1 = b.d * l + b.v * r;
+    double w2 = b.dd * l + 2 * b.d * r + b.v * (a.dd / a.v - r * r);
+    return (Dual){y, y * w1, y * (w2 + w1 * w1)};
+  }
+  case oPOWI:
+    return chain(a, y, imm * pow(a.v, imm - 1),
+                 imm * (imm - 1) * pow(a.v, imm - 2));
+  case oNEG:
+    return (Dual){y, -a.d, -a.dd};
+  case oFACT:
+  case oFLOOR:
+  case oCEIL:
+    return (Dual){y, 0, 0};
+  case oABS: {
+    double s = a.v > 0 ? 1 : a.v < 0 ? -1 : 0;
+    return (Dual){y, s * a.d, s * a.dd};
+  }
+  case oSQRT:
+    return chain(a, y, 0.5 / y, -0.25 / (y * y * y));
+  case oEXP:
+    return chain(a, y, y, y);
+  case oLN:
+    return chain(a, y, 1 / a.v, -1 / (a.v * a.v));
+  case oLOG:
+    return chain(a, y, 1 / (a.v * M_LN10), -1 / (a.v * a.v * M_LN10));
+  case oSIN:
+    return chain(a, y, cos(a.v), -y);
+  case oCOS:
+    return chain(a, y, -sin(a.v), -y);
+  case oTAN:
+    return chain(a, y, 1 + y * y, 2 * y * (1 + y * y));
+  case oASIN:
+  case oACOS: {
+    double q = 1 - a.v * a.v, g1 = 1 / sqrt(q);
+    double s = op == oASIN ? 1 : -1;
+    return chain(a, y, s * g1, s * a.v * g1 / q);
+  }
+  case oATAN: {
+    double q = 1 + a.v * a.v;
+    return chain(a, y, 1 / q, -2 * a.v / (q * q));
+  }
+  case oSINH:
+    return chain(a, y, cosh(a.v), y);
+  case oCOSH:
+    return chain(a, y, sinh(a.v), y);
+  case oTANH:
+    return chain(a, y, 1 - y * y, -2 * y * (1 - y * y));
+  default:
+    return (Dual){NAN, NAN, NAN};
+  }
+}
+
+// f, f' and f'' at x in one pass over the program, all NaN where p_run
+// would give NaN through an error
+Dual p_dual(const Prog *pg, double x) {
+  Dual bad = {NAN, NAN, NAN};
+  if (!pg || pg->len == 0)
+    return bad;
+
+  Dual buf[64];
+  Dual *st = pg->depth <= 64 ? buf : malloc(pg->depth * sizeof(Dual));
+  if (!st)
+    return bad;
+  int sp = 0, e = 0;
+  st[0] = bad;
+
+  for (int i = 0; i < pg->len; i++) {
+    const CInstr *in = &pg->code[i];
+    if (in->op == oNUM) {
+      st[sp++] = (Dual){in->v, 0, 0};
+    } else if (in->op == oX) {
+      st[sp++] = (Dual){x, 1, 0};
+    } else if (in->op >= oADD && in->op <= oPOW) {
+      sp--;
+      st[sp - 1] = dop(in->op, st[sp - 1], st[sp], 0, &e);
+    } else {
+      st[sp - 1] = dop(in->op, st[sp - 1], bad, in->v, &e);
+    }
+  }
+
+  Dual result = st[0];
+  if (st != buf)
+    free(st);
+  return e ? bad : result;
+}
+
+static void dual_block(const Prog *pg, const double *xs, Dual *ys, int m,
+                       Dual *st) {
+  uint64_t err = 0;
+  int sp = 0;
+
+  for (int i = 0; i < pg->len; i++) {
+    const CInstr *in = &pg->code[i];
+    Op op = in->op;
+    Dual *r = st + sp * pBlock;
+    if (op == oNUM || op == oX) {
+      for (int j = 0; j < m; j++)
+        r[j] = op == oNUM ? (Dual){in->v, 0, 0} : (Dual){xs[j], 1, 0};
+      sp++;
+      continue;
+    }
+    int bin = op >= oADD && op <= oPOW;
+    Dual *a = r - (bin ? 2 : 1) * pBlock, *b = r - pBlock;
+    for (int j = 0; j < m; j++) {
+      int e = 0;
+      a[j] = dop(op, a[j], b[j], in->v, &e);
+      if (e)
+        err |= (uint64_t)1 << j;
+    }
+    sp -= bin;
+  }
+
+  for (int j = 0; j < m; j++)
+    ys[j] = (err >> j) & 1 ? (Dual){NAN, NAN, NAN} : st[j];
+}
+
+void p_dual_batch(const Prog *pg, const double *xs, Dual *ys, int n) {
+  Dual *st = pg && pg->len ? malloc(pg->depth * pBlock * sizeof(Dual)) : NULL;
+  if (!st) {
+    for (int i = 0; i < n; i++)
+      ys[i] = (Dual){NAN, NAN, NAN};
+    return;
+  }
+  for (int i = 0; i < n; i += pBlock)
+    dual_block(pg, xs + i, ys + i, n - i < pBlock ? n - i : pBlock, st);
+  free(st);
+}
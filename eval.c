@@ -0,0 +1,220 @@
+// Created by Unium on 18.10.26
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "kern.h"
+#include "parser.h"
+#include "types.h"
+
+#define pBlock 64
+
+static double factorial(double n) {
+  if (n < 0 || n != floor(n))
+    return NAN;
+  if (n > 170)
+    return INFINITY;
+  if (n == 0 || n == 1)
+    return 1.0;
+  double result = 1.0;
+  for (int i = 2; i <= (int)n; i++)
+    result *= i;
+  return result;
+}
+
+int p_in_dom(Dom d, double a) {
+  switch (d) {
+  case dUNIT:
+    return !(a < -1.0 || a > 1.0);
+  case dNONNEG:
+    return !(a < 0.0);
+  case dPOS:
+    return !(a <= 0.0);
+  default:
+    return 1;
+  }
+}
+
+// one op on scalars, e is set for the errors that poison a whole sample.
+// unary ops get the instruction's immediate in b
+static inline double op1(Op op, double a, double b, int *e) {
+  switch (op) {
+  case oADD:
+    return a + b;
+  case oSUB:
+    return a - b;
+  case oMUL:
+    return a * b;
+  case oDIV:
+    if (fabs(b) < 1e-15)
+      *e = 1;
+    return a / b;
+  case oMOD:
+    if (fabs(b) < 1e-15)
+      *e = 1;
+    return fmod(a, b);
+  case oPOW:
+    return pow(a, b);
+  case oNEG:
+    return -a;
+  case oFACT:
+    a = factorial(a);
+    if (isnan(a) || isinf(a))
+      *e = 1;
+    return a;
+  case oPOWI: {
+    double r = 1.0;
+    for (int k = (int)b; k; k >>= 1) {
+      if (k & 1)
+        r *= a;
+      a *= a;
+    }
+    return r;
+  }
+  // single instructions, not worth the call through the registry
+  case oSQRT:
+    return a < 0.0 ? NAN : sqrt(a);
+  case oABS:
+    return fabs(a);
+  case oFLOOR:
+    return floor(a);
+  case oCEIL:
+    return ceil(a);
+  default: {
+    // every other op is a builtin function, which sits at its op
+    const Builtin *bi = &p_builtins[op];
+    return bi->fn && p_in_dom(bi->dom, a) ? bi->fn(a) : NAN;
+  }
+  }
+}
+
+double p_op(Op op, double a, double b, int *e) { return op1(op, a, b, e); }
+
+static int binary(Op op) { return op >= oADD && op <= oPOW; }
+
+// division by ~0 and factorial overflow poison the whole sample, the same
+// way the recursive parser used to bail out with e set
+double p_run(const Prog *pg, double x) {
+  if (!pg || pg->len == 0)
+    return NAN;
+
+  double buf[64];
+  double *st = pg->depth <= 64 ? buf : malloc(pg->depth * sizeof(double));
+  if (!st)
+    return NAN;
+  int sp = 0, e = 0;
+  st[0] = NAN;
+
+  for (int i = 0; i < pg->len; i++) {
+    const CInstr *in = &pg->code[i];
+    if (in->op == oNUM) {
+      st[sp++] = in->v;
+    } else if (in->op == oX) {
+      st[sp++] = x;
+    } else if (binary(in->op)) {
+      sp--;
+      st[sp - 1] = op1(in->op, st[sp - 1], st[sp], &e);
+    } else {
+      st[sp - 1] = op1(in->op, st[sp - 1], in->v, &e);
+    }
+  }
+
+  double result = st[0];
+  if (st != buf)
+    free(st);
+  return e ? NAN : result;
+}
+
+// runs the program over up to pBlock lanes at once, so the op dispatch is
+// paid once per block instead of once per sample. k handles whole vectors,
+// so st must be zeroed up front and lanes m..mv are scratch
+static void run_block(const Kern *k, const Prog *pg, const double *xs,
+                      double *ys, int m, double *st) {
+  uint64_t err = 0;
+  int sp = 0, mv = (m + 3) & ~3;
+
+  for (int i = 0; i < pg->len; i++) {
+    const CInstr *in = &pg->code[i];
+    Op op = in->op;
+    double *r = st + sp * pBlock;
+    if (op == oNUM) {
+      for (int j = 0; j < m; j++)
+        r[j] = in->v;
+      sp++;
+      continue;
+    }
+    if (op == oX) {
+      for (int j = 0; j < m; j++)
+        r[j] = xs[j];
+      sp++;
+      continue;
+    }
+    if (binary(op)) {
+      double *l = r - 2 * pBlock, *b = r - pBlock;
+      sp--;
+      if (k->bin(op, l, b, mv, &err))
+        continue;
+      for (int j = 0; j < m; j++) {
+        int e = 0;
+        l[j] = op1(op, l[j], b[j], &e);
+        if (e)
+          err |= (uint64_t)1 << j;
+      }
+      continue;
+    }
+    double *a = r - pBlock;
+    if (k->un(op, a, mv, in->v))
+      continue;
+    for (int j = 0; j < m; j++) {
+      int e = 0;
+      a[j] = op1(op, a[j], in->v, &e);
+      if (e)
+        err |= (uint64_t)1 << j;
+    }
+  }
+
+  for (int j = 0; j < m; j++)
+    ys[j] = (err >> j) & 1 ? NAN : st[j];
+}
+
+void p_batch(const Prog *pg, const double *xs, double *ys, int n) {
+  const Kern *k = k_get();
+  double *st = pg && pg->len ? calloc(pg->depth * pBlock, sizeof(double))
+                             : NULL;
+  if (!st) {
+    for (int i = 0; i < n; i++)
+      ys[i] = NAN;
+    return;
+  }
+  for (int i = 0; i < n; i += pBlock) {
+    int m = n - i < pBlock ? n - i : pBlock;
+    if (pg->jit)
+      p_jit_run(pg, xs + i, ys + i, m, st);
+    else
+      run_block(k, pg, xs + i, ys + i, m, st);
+  }
+  free(st);
+}
+
+void p_lin(const Prog *pg, double a, double b, int n, double *ys) {
+  const Kern *k = k_get();
+  double *st = pg && pg->len ? calloc(pg->depth * pBlock, sizeof(double))
+                             : NULL;
+  if (!st) {
+    for (int i = 0; i < n; i++)
+      ys[i] = NAN;
+    return;
+  }
+  double xs[pBlock];
+  for (int i = 0; i < n; i += pBlock) {
+    int m = n - i < pBlock ? n - i : pBlock;
+    for (int j = 0; j < m; j++)
+      xs[j] = a + (b - a) * (i + j) / n;
+    if (pg->jit)
+      p_jit_run(pg, xs, ys + i, m, st);
+    else
+      run_block(k, pg, xs, ys + i, m, st);
+  }
+  free(st);
+}
@@ -1,14 +1,17 @@
 // Created by Unium on 06.02.26
 
 #include "graph.h"
+#include "maths.h"
 #include "parser.h"
-#include "stb_image_write.h"
 #include "types.h"
+#include <ctype.h>
 #include <math.h>
 #include <ncurses.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 static const CDef cmds[cmdCount] = {
     {"q", "q", "Quit mathplot"},
@@ -16,14 +19,28 @@ static const CDef cmds[cmdCount] = {
     {"help", "help", "Show help"},
     {"integrate", "integrate", "Integration mode"},
     {"add", "add <expr>", "Add function #n"},
+    {"deriv", "deriv <n>", "Plot f' of #n"},
     {"remove", "remove <n>", "Remove function #n"},
     {"select", "select <n>", "Select function #n"},
+    {"view", "view <rect>", "Set x0 x1 y0 y1"},
     {"w", "w <file>", "Export as ASCII text"},
-    {"wi", "wi <file>", "Export as PNG image"},
+    {"wi", "wi <file> [WxH]", "Export as PNG image"},
+    {"ws", "ws <file> [WxH]", "Export as SVG or PDF"},
 };
 
 const CDef *g_cmds(void) { return cmds; }
 
+// start of the word tab completion replaces, 0 while the command itself is
+// being typed
+int g_cmd_word(const char *inp) {
+  int len = strlen(inp);
+  if (!strchr(inp, ' '))
+    return 0;
+  while (len > 0 && isalpha((unsigned char)inp[len - 1]))
+    len--;
+  return len;
+}
+
 int g_cmd_matches(const char *inp, const CDef **matches, int mm) {
   int c = 0;
   int len = strlen(inp);
@@ -42,9 +59,26 @@ int g_cmd_matches(const char *inp, const CDef **matches, int mm) {
   }
   c_part[c_len] = '\0';
 
-  for (int i = 0; i < len; i++) {
-    if (inp[i] == ' ')
+  int w = g_cmd_word(inp);
+  if (w > 0) {
+    // inside a formula, complete the identifier being typed
+    if (strcmp(c_part, "add") != 0 || w == len)
       return 0;
+    for (int i = 0; i < p_nbuiltins && c < mm; i++) {
+      const char *n = p_builtins[i].def.c;
+      if (n && strncasecmp(n, inp + w, len - w) == 0)
+        matches[c++] = &p_builtins[i].def;
+    }
+    // shortest first, so tab on "sin" stays sin rather than sinh
+    for (int i = 1; i < c; i++) {
+      for (int j = i;
+           j > 0 && strlen(matches[j]->c) < strlen(matches[j - 1]->c); j--) {
+        const CDef *t = matches[j];
+        matches[j] = matches[j - 1];
+        matches[j - 1] = t;
+      }
+    }
+    return c;
   }
 
   for (int i = 0; i < cmdCount && c < mm; i++) {
@@ -55,51 +89,63 @@ int g_cmd_matches(const char *inp, const CDef **matches, int mm) {
   return c;
 }
 
-void export_text(const char *f_name, char **buff, int h, int w) {
-  FILE *f = fopen(f_name, "w");
-  if (!f)
-    return;
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++)
-      fputc(buff[y][x], f);
-    fputc('\n', f);
-  }
-  fclose(f);
+static int changed(const PFrame *fb, size_t i) {
+  size_t n = (size_t)fb->w * fb->h;
+  return !fb->valid || fb->prev[i] != (unsigned char)fb->glyph[i] ||
+         fb->prev[n + i] != fb->col[i] || fb->prev[2 * n + i] != fb->attr[i];
 }
 
-void export_png(const char *f_name, char **buff, int h, int w) {
-  int char_w = 6, char_h = 12;
-  int img_w = w * char_w;
-  int img_h = h * char_h;
-  unsigned char *ps = calloc(img_w * img_h * 3, 1);
-  if (!ps)
-    return;
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++) {
-      char c = buff[y][x];
-      unsigned char brightness = 30;
-      if (c == '#' || c == '*' || c == 'O')
-        brightness = 255;
-      else if (c == '+' || c == '.')
-        brightness = 200;
-      else if (c == '-' || c == '|')
-        brightness = 100;
-      else if (c == ':')
-        brightness = 150;
-      for (int cy = 0; cy < char_h; cy++) {
-        for (int cx = 0; cx < char_w; cx++) {
-          int px = x * char_w + cx;
-          int py = y * char_h + cy;
-          int idx = (py * img_w + px) * 3;
-          ps[idx] = brightness;
-          ps[idx + 1] = c == '0' ? 255 : brightness;
-          ps[idx + 2] = brightness;
-        }
+static chtype frame_attr(const PFrame *fb, size_t i) {
+  return (fb->col[i] ? COLOR_PAIR(fb->col[i]) : 0) |
+         (fb->attr[i] & pBOLD ? A_BOLD : 0) |
+         (fb->attr[i] & pREVERSE ? A_REVERSE : 0);
+}
+
+// draws the cells of fb that changed since the last flush into win at
+// (oy, ox), one call per run with the same colour and attributes. all of
+// them when the window no longer shows the last frame
+static void frame_flush(WINDOW *win, PFrame *fb, int oy, int ox) {
+  size_t n = (size_t)fb->w * fb->h;
+  for (int y = 0; y < fb->h; y++) {
+    size_t r = (size_t)y * fb->w;
+    for (int x = 0; x < fb->w;) {
+      if (!changed(fb, r + x)) {
+        x++;
+        continue;
       }
+      int e = x + 1;
+      while (e < fb->w && changed(fb, r + e) &&
+             fb->col[r + e] == fb->col[r + x] &&
+             fb->attr[r + e] == fb->attr[r + x])
+        e++;
+      wattrset(win, frame_attr(fb, r + x));
+      mvwaddnstr(win, oy + y, ox + x, fb->glyph + r + x, e - x);
+      x = e;
     }
   }
-  stbi_write_png(f_name, img_w, img_h, 3, ps, img_w * 3);
-  free(ps);
+  wattrset(win, A_NORMAL);
+  memcpy(fb->prev, fb->glyph, n * 3);
+  fb->valid = 1;
+}
+
+// text at window row y, column x, clipped to the frame inside the border
+static void frame_print(PFrame *fb, int y, int x, int col, int attr,
+                        const char *fmt, ...) {
+  char s[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(s, sizeof(s), fmt, ap);
+  va_end(ap);
+  y--;
+  x--;
+  if (y < 0 || y >= fb->h || x < 0)
+    return;
+  for (int k = 0; s[k] && x + k < fb->w; k++) {
+    size_t i = (size_t)y * fb->w + x + k;
+    fb->glyph[i] = s[k];
+    fb->col[i] = col;
+    fb->attr[i] = attr;
+  }
 }
 
 void d_help(WINDOW *win) {
@@ -118,7 +164,9 @@ void d_help(WINDOW *win) {
   mvwprintw(win, y++, 3, "t       - Trace mode (examine curve)");
   mvwprintw(win, y++, 3, ":       - Command mode");
   mvwprintw(win, y++, 3, "+/-     - Zoom in/out");
+  mvwprintw(win, y++, 3, "H/L J/K - Pan (also Left/Right)");
   mvwprintw(win, y++, 3, "r       - Reset view");
+  mvwprintw(win, y++, 3, "e       - Envelope/sampled curves");
   mvwprintw(win, y++, 3, "q       - Quit");
   y++;
   wattron(win, COLOR_PAIR(6) | A_BOLD);
@@ -133,73 +181,120 @@ void d_help(WINDOW *win) {
   mvwprintw(win, y++, 2, "Commands (press :):");
   wattroff(win, COLOR_PAIR(6) | A_BOLD);
   mvwprintw(win, y++, 3, ":add <expr>  - Add function");
+  mvwprintw(win, y++, 3, ":deriv <n>   - Add derivative of function n");
   mvwprintw(win, y++, 3, ":remove <n>  - Remove function n");
   mvwprintw(win, y++, 3, ":select <n>  - Select function n");
+  mvwprintw(win, y++, 3, ":view x0 x1 y0 y1 - Set the view");
   mvwprintw(win, y++, 3, ":integrate   - Enter integration mode");
   mvwprintw(win, y++, 3, ":w <file>    - Export ASCII to file");
-  mvwprintw(win, y++, 3, ":wi <file>   - Export PNG image");
+  mvwprintw(win, y++, 3, ":wi <file> [WxH] - Export PNG image");
+  mvwprintw(win, y++, 3, ":ws <file> [WxH] - Export SVG, or PDF for .pdf");
   mvwprintw(win, y++, 3, ":help        - Show this help");
   mvwprintw(win, y++, 3, ":q or :quit  - Quit");
   y++;
+  wattron(win, COLOR_PAIR(6) | A_BOLD);
+  mvwprintw(win, y++, 2, "Functions:");
+  wattroff(win, COLOR_PAIR(6) | A_BOLD);
+  int fx = 3;
+  for (int i = 0; i < p_nbuiltins && y < h - 3; i++) {
+    const char *n = p_builtins[i].def.s;
+    if (!n)
+      continue;
+    int nl = strlen(n);
+    if (fx + nl > w - 3) {
+      fx = 3;
+      y++;
+    }
+    if (y < h - 3)
+      mvwprintw(win, y, fx, "%s", n);
+    fx += nl + 2;
+  }
+  y++;
   wattron(win, COLOR_PAIR(2) | A_BOLD);
   mvwprintw(win, h - 2, (w - 25) / 2, "Press any key to close");
   wattroff(win, COLOR_PAIR(2) | A_BOLD);
   wrefresh(win);
 }
 
-void d_sidebar(WINDOW *win, FLists *funcs, PView *v, Mode mode,
+// equal up to spaces and case, so "x^2+1" doesn't echo as "x^2 + 1"
+static int same_text(const char *a, const char *b) {
+  for (;; a++, b++) {
+    while (*a == ' ')
+      a++;
+    while (*b == ' ')
+      b++;
+    if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+      return 0;
+    if (!*a)
+      return 1;
+  }
+}
+
+void d_sidebar(WINDOW *win, PFrame *fb, FLists *funcs, PView *v, Mode mode,
                const char *cmd_input, int show_deriv, double trace_X,
                double trace_slope, IntegrationState *integ) {
   int h, w;
   getmaxyx(win, h, w);
-  (void)w; // kys
-  werase(win);
+  if (d_frame_reset(fb, w - 2, h - 2) != 0 || !fb->valid) {
+    werase(win);
+    fb->valid = 0;
+  }
   box(win, 0, 0);
-  wattron(win, COLOR_PAIR(7) | A_BOLD);
-  mvwprintw(win, 1, 2, "=================================");
-  mvwprintw(win, 2, 2, "            mathplot             ");
-  mvwprintw(win, 3, 2, "=================================");
-  wattroff(win, COLOR_PAIR(7) | A_BOLD);
+  if (!fb->w) {
+    wrefresh(win);
+    return;
+  }
+  frame_print(fb, 1, 2, 7, pBOLD, "=================================");
+  frame_print(fb, 2, 2, 7, pBOLD, "            mathplot             ");
+  frame_print(fb, 3, 2, 7, pBOLD, "=================================");
 
-  wattron(win, COLOR_PAIR(6) | A_BOLD);
-  mvwprintw(win, 5, 2, "Functions:");
-  wattroff(win, COLOR_PAIR(6) | A_BOLD);
+  frame_print(fb, 5, 2, 6, pBOLD, "Functions:");
   for (int i = 0; i < funcs->count && i < 6; i++) {
-    if (i == funcs->sel)
-      wattron(win, A_REVERSE);
-    wattron(win, COLOR_PAIR(funcs->functions[i].col));
     char disp[28];
     snprintf(disp, sizeof(disp), "%d. %s", i + 1, funcs->functions[i].formula);
     disp[27] = '\0';
-    mvwprintw(win, 6 + i, 3, "%-30s", disp);
-    wattroff(win, COLOR_PAIR(funcs->functions[i].col));
-    if (i == funcs->sel)
-      wattroff(win, A_REVERSE);
+    frame_print(fb, 6 + i, 3, funcs->functions[i].col,
+                i == funcs->sel ? pREVERSE : 0, "%-30s", disp);
   }
 
   int info_Y = 13;
-  wattron(win, COLOR_PAIR(6) | A_BOLD);
-  mvwprintw(win, info_Y++, 2, "View:");
-  wattroff(win, COLOR_PAIR(6) | A_BOLD);
-  wattron(win, COLOR_PAIR(5));
-  mvwprintw(win, info_Y++, 3, "x: [%.2f, %.2f]", v->mX, v->mmX);
-  mvwprintw(win, info_Y++, 3, "y: [%.2f, %.2f]", v->mY, v->mmY);
+  frame_print(fb, info_Y++, 2, 6, pBOLD, "View:");
+  frame_print(fb, info_Y++, 3, 5, 0, "x: [%.2f, %.2f]", v->mX, v->mmX);
+  frame_print(fb, info_Y++, 3, 5, 0, "y: [%.2f, %.2f]", v->mY, v->mmY);
+
+  // the colour of the view lines carries on to the lines below, up to the
+  // next heading
+  int c = 5;
+  if (funcs->count > 0) {
+    F *f = &funcs->functions[funcs->sel];
+    char simp[256];
+    p_format(f_prog(f), simp, sizeof(simp));
+    if (simp[0] && !same_text(simp, f->formula))
+      frame_print(fb, info_Y++, 3, c, 0, "= %.28s", simp);
+    if (f->evals)
+      frame_print(fb, info_Y++, 3, c, 0, "evals: %d", f->evals);
+    long hit, miss;
+    size_t bytes;
+    f_cache_stats(&hit, &miss, &bytes);
+    if (hit + miss)
+      frame_print(fb, info_Y++, 3, c, 0, "cache: %ld/%ld hit, %zuk", hit,
+                  hit + miss, bytes >> 10);
+  }
 
   if (mode == mTRACE && show_deriv && !isnan(trace_slope)) {
     info_Y++;
-    wattron(win, COLOR_PAIR(3) | A_BOLD);
-    mvwprintw(win, info_Y++, 2, "Derivative:");
-    wattroff(win, COLOR_PAIR(3) | A_BOLD);
-    mvwprintw(win, info_Y++, 3, "f'(%.3f) = %.6f", trace_X, trace_slope);
+    frame_print(fb, info_Y++, 2, 3, pBOLD, "Derivative:");
+    c = 0;
+    frame_print(fb, info_Y++, 3, c, 0, "f'(%.3f) = %.6f", trace_X,
+                trace_slope);
   }
 
   if (integ->active && !isnan(integ->result)) {
     info_Y++;
-    wattron(win, COLOR_PAIR(2) | A_BOLD);
-    mvwprintw(win, info_Y++, 2, "Integral:");
-    wattroff(win, COLOR_PAIR(2) | A_BOLD);
-    mvwprintw(win, info_Y++, 3, "[%.2f, %.2f] = %.6f", integ->a, integ->b,
-              integ->result);
+    frame_print(fb, info_Y++, 2, 2, pBOLD, "Integral:");
+    c = 0;
+    frame_print(fb, info_Y++, 3, c, 0, "[%.2f, %.2f] = %.6f", integ->a,
+                integ->b, integ->result);
   }
 
   int input_Y = h - 4;
@@ -211,228 +306,69 @@ void d_sidebar(WINDOW *win, FLists *funcs, PView *v, Mode mode,
       if (bs_Y < 17)
         bs_Y = 17;
 
-      wattron(win, COLOR_PAIR(7));
-      mvwprintw(win, bs_Y, 2, "Suggestions:");
-      wattroff(win, COLOR_PAIR(7));
-
+      frame_print(fb, bs_Y, 2, 7, 0, "Suggestions:");
       for (int i = 0; i < m_count && bs_Y + 1 + i < input_Y - 1; i++) {
-        if (i == 0) {
-          wattron(win, COLOR_PAIR(2) | A_BOLD);
-        } else {
-          wattron(win, COLOR_PAIR(7));
-        }
-
         char s[32];
         snprintf(s, sizeof(s), " %-12s %s", matches[i]->s, matches[i]->d);
-        mvwprintw(win, bs_Y + 1 + i, 2, "%-30s", s);
-
-        if (i == 0) {
-          wattroff(win, COLOR_PAIR(2) | A_BOLD);
-        } else {
-          wattroff(win, COLOR_PAIR(7));
-        }
+        frame_print(fb, bs_Y + 1 + i, 2, i == 0 ? 2 : 7, i == 0 ? pBOLD : 0,
+                    "%-30s", s);
       }
     }
 
-    wattron(win, COLOR_PAIR(4) | A_BOLD);
-    mvwprintw(win, input_Y, 2, ":%s_", cmd_input);
-    wattroff(win, COLOR_PAIR(4) | A_BOLD);
-
-    wattron(win, COLOR_PAIR(8));
-    mvwprintw(win, input_Y + 1, 2, "TAB: complete ESC: cancel");
-    wattroff(win, COLOR_PAIR(8));
+    frame_print(fb, input_Y, 2, 4, pBOLD, ":%s_", cmd_input);
+    frame_print(fb, input_Y + 1, 2, 8, 0, "TAB: complete ESC: cancel");
   } else if (mode == mTRACE) {
-    wattron(win, COLOR_PAIR(2) | A_BOLD);
-    mvwprintw(win, input_Y - 1, 2, "-- TRACE --");
-    mvwprintw(win, input_Y, 2, "d:deriv h/l:move n/p:crit");
-    wattroff(win, COLOR_PAIR(2) | A_BOLD);
+    frame_print(fb, input_Y - 1, 2, 2, pBOLD, "-- TRACE --");
+    frame_print(fb, input_Y, 2, 2, pBOLD, "d:deriv h/l:move n/p:crit");
   } else if (mode == mINTEGRATE) {
-    wattron(win, COLOR_PAIR(5) | A_BOLD);
-    mvwprintw(win, input_Y - 1, 2, "-- INTEGRATE --");
-    mvwprintw(win, input_Y, 2,
-              integ->selStart ? "Set a: <- ->" : "Set b: <- ->");
-    wattroff(win, COLOR_PAIR(5) | A_BOLD);
+    frame_print(fb, input_Y - 1, 2, 5, pBOLD, "-- INTEGRATE --");
+    frame_print(fb, input_Y, 2, 5, pBOLD,
+                integ->selStart ? "Set a: <- ->" : "Set b: <- ->");
   } else if (mode == mINSERT) {
-    wattron(win, COLOR_PAIR(3) | A_BOLD);
-    mvwprintw(win, input_Y - 1, 2, "-- INSERT --");
-    wattroff(win, COLOR_PAIR(3) | A_BOLD);
-    if (funcs->count > 0) {
-      mvwprintw(win, input_Y, 2, "f(x) = %s_",
-                funcs->functions[funcs->sel].formula);
-    }
+    frame_print(fb, input_Y - 1, 2, 3, pBOLD, "-- INSERT --");
+    if (funcs->count > 0)
+      frame_print(fb, input_Y, 2, 0, 0, "f(x) = %s_",
+                  funcs->functions[funcs->sel].formula);
   } else {
-    wattron(win, COLOR_PAIR(5) | A_BOLD);
-    mvwprintw(win, input_Y - 1, 2, "-- NORMAL --");
-    wattroff(win, COLOR_PAIR(5) | A_BOLD);
-    mvwprintw(win, input_Y, 2, ":help for commands");
+    frame_print(fb, input_Y - 1, 2, 5, pBOLD, "-- NORMAL --");
+    frame_print(fb, input_Y, 2, 0, 0, ":help for commands");
   }
 
+  frame_flush(win, fb, 1, 1);
   wrefresh(win);
 }
 
-void d_plot(WINDOW *win, FLists *funcs, PView *v, int trace_mode,
-            double trace_X, int show_deriv, double trace_slope,
-            IntegrationState *integ) {
+// shows img, the plot d_render drew for s
+void d_plot(WINDOW *win, PFrame *fb, const PFrame *img, const PScene *s) {
   int height, width;
   getmaxyx(win, height, width);
-  werase(win);
+  int plot_H = height - 4;
+  int plot_W = width - 4;
+  if (d_frame_reset(fb, plot_W, plot_H) != 0 || !fb->valid ||
+      s->funcs.count == 0) {
+    werase(win);
+    fb->valid = 0;
+  }
   box(win, 0, 0);
-  if (funcs->count == 0) {
+  if (!fb->w) {
+    wrefresh(win);
+    return;
+  }
+  if (s->funcs.count == 0) {
     wattron(win, COLOR_PAIR(8));
     mvwprintw(win, height / 2, (width - 30) / 2, "Enter a function to plot...");
     wattroff(win, COLOR_PAIR(8));
     wrefresh(win);
     return;
   }
-  int plot_H = height - 4;
-  int plot_W = width - 4;
-  char **buff = malloc(plot_H * sizeof(char *));
-  int **cols = malloc(plot_H * sizeof(int *));
-  for (int i = 0; i < plot_H; i++) {
-    buff[i] = malloc(plot_W);
-    cols[i] = calloc(plot_W, sizeof(int));
-    memset(buff[i], ' ', plot_W);
-  }
-  int zero_y = (int)((0 - v->mY) / (v->mmY - v->mY) * plot_H);
-  int zero_x = (int)((0 - v->mX) / (v->mmX - v->mX) * plot_W);
-  if (zero_y >= 0 && zero_y < plot_H) {
-    for (int x = 0; x < plot_W; x++)
-      buff[plot_H - 1 - zero_y][x] = '-';
-  }
-  if (zero_x >= 0 && zero_x < plot_W) {
-    for (int y = 0; y < plot_H; y++)
-      buff[y][zero_x] = '|';
-  }
-  if (zero_y >= 0 && zero_y < plot_H && zero_x >= 0 && zero_x < plot_W) {
-    buff[plot_H - 1 - zero_y][zero_x] = '+';
-  }
-  if (integ->active && funcs->count > 0) {
-    const char *formula = funcs->functions[funcs->sel].formula;
-    double a_px = (integ->a - v->mX) / (v->mmX - v->mX) * plot_W;
-    double b_px = (integ->b - v->mX) / (v->mmX - v->mX) * plot_W;
-    int start_px = (int)fmin(a_px, b_px);
-    int end_px = (int)fmax(a_px, b_px);
-    if (start_px < 0)
-      start_px = 0;
-    if (end_px >= plot_W)
-      end_px = plot_W - 1;
-
-    for (int px = start_px; px <= end_px; px++) {
-      double val_X = v->mX + (v->mmX - v->mX) * px / plot_W;
-      double val_Y = p_eval(formula, val_X);
-      if (isnan(val_Y) || isinf(val_Y))
-        continue;
-      int py = (int)((val_Y - v->mY) / (v->mmY - v->mY) * plot_H);
-      int zero_py = (int)((0 - v->mY) / (v->mmY - v->mY) * plot_H);
-      int start_Y = fmin(py, zero_py);
-      int end_Y = fmax(py, zero_py);
-      for (int fill_y = start_Y; fill_y <= end_Y; fill_y++) {
-        if (fill_y >= 0 && fill_y < plot_H) {
-          int buf_y = plot_H - 1 - fill_y;
-          if (buff[buf_y][px] == ' ')
-            buff[buf_y][px] = '.';
-        }
-      }
-    }
-  }
-  for (int f = 0; f < funcs->count; f++) {
-    if (!funcs->functions[f].active)
-      continue;
-    const char *formula = funcs->functions[f].formula;
-    int color = funcs->functions[f].col;
-    int samples = plot_W * 3;
-    double prev_Y = NAN;
-    int prev_py = -1;
-
-    for (int i = 0; i < samples; i++) {
-      double x = v->mX + (v->mmX - v->mX) * i / samples;
-      double y = p_eval(formula, x);
-      if (isnan(y) || isinf(y)) {
-        prev_Y = NAN;
-        prev_py = -1;
-        continue;
-      }
-
-      int px = (int)((x - v->mX) / (v->mmX - v->mX) * plot_W);
-      int py = (int)((y - v->mY) / (v->mmY - v->mY) * plot_H);
-
-      if (px >= 0 && px < plot_W && py >= 0 && py < plot_H) {
-        buff[plot_H - 1 - py][px] = '*';
-        cols[plot_H - 1 - py][px] = color;
-        if (!isnan(prev_Y) && prev_py >= 0) {
-          int steps = abs(py - prev_py);
-          if (steps > 1 && steps < 20) {
-            for (int s = 1; s < steps; s++) {
-              int interp_py = prev_py + (py - prev_py) * s / steps;
-              if (interp_py >= 0 && interp_py < plot_H) {
-                buff[plot_H - 1 - interp_py][px] = '+';
-                cols[plot_H - 1 - interp_py][px] = color;
-              }
-            }
-          }
-        }
-      }
-      prev_Y = y;
-      prev_py = py;
-    }
-  }
-  if (trace_mode && show_deriv && !isnan(trace_slope) && funcs->count > 0) {
-    double trace_Y = p_eval(funcs->functions[funcs->sel].formula, trace_X);
-    if (!isnan(trace_Y)) {
-      for (int px = 0; px < plot_W; px++) {
-        double x = v->mX + (v->mmX - v->mX) * px / plot_W;
-        double tang_Y = trace_Y + trace_slope * (x - trace_X);
-        int py = (int)((tang_Y - v->mY) / (v->mmY - v->mY) * plot_H);
-        if (py >= 0 && py < plot_H) {
-          int buf_y = plot_H - 1 - py;
-          if (buff[buf_y][px] == ' ' || buff[buf_y][px] == '-' ||
-              buff[buf_y][px] == '|') {
-            buff[buf_y][px] = ':';
-            cols[buf_y][px] = 3;
-          }
-        }
-      }
-    }
-  }
-  if (trace_mode && funcs->count > 0) {
-    double trace_Y = p_eval(funcs->functions[funcs->sel].formula, trace_X);
-    if (!isnan(trace_Y) && !isinf(trace_Y)) {
-      int trace_px = (int)((trace_X - v->mX) / (v->mmX - v->mX) * plot_W);
-      int trace_py = (int)((trace_Y - v->mY) / (v->mmY - v->mY) * plot_H);
-      if (trace_px >= 0 && trace_px < plot_W && trace_py >= 0 &&
-          trace_py < plot_H) {
-        buff[plot_H - 1 - trace_py][trace_px] = 'O';
-        cols[plot_H - 1 - trace_py][trace_px] = 3;
-      }
-    }
-  }
-  for (int y = 0; y < plot_H; y++) {
-    for (int x = 0; x < plot_W; x++) {
-      char c = buff[y][x];
-      int color = cols[y][x] ? cols[y][x] : 6;
-      if (c == '-' || c == '|' || c == '+')
-        color = 6;
-      if (c != ' ')
-        wattron(win, COLOR_PAIR(color) | (c == 'O' || c == '*' ? A_BOLD : 0));
-      mvwaddch(win, y + 2, x + 2, c);
-      if (c != ' ')
-        wattroff(win, COLOR_PAIR(color) | (c == 'O' || c == '*' ? A_BOLD : 0));
-    }
-  }
-  if (trace_mode && funcs->count > 0) {
-    double trace_Y = p_eval(funcs->functions[funcs->sel].formula, trace_X);
-    if (!isnan(trace_Y)) {
-      wattron(win, COLOR_PAIR(3) | A_BOLD | A_REVERSE);
-      mvwprintw(win, height - 1, (width - 32) / 2, " X: %.4f  Y: %.4f ",
-                trace_X, trace_Y);
-      wattroff(win, COLOR_PAIR(3) | A_BOLD | A_REVERSE);
-    }
-  }
-  for (int i = 0; i < plot_H; i++) {
-    free(buff[i]);
-    free(cols[i]);
+  if (img->w == plot_W && img->h == plot_H)
+    memcpy(fb->glyph, img->glyph, (size_t)plot_W * plot_H * 3);
+  frame_flush(win, fb, 2, 2);
+  if (s->trace_mode && !isnan(s->trace_Y)) {
+    wattron(win, COLOR_PAIR(3) | A_BOLD | A_REVERSE);
+    mvwprintw(win, height - 1, (width - 32) / 2, " X: %.4f  Y: %.4f ",
+              s->trace_X, s->trace_Y);
+    wattroff(win, COLOR_PAIR(3) | A_BOLD | A_REVERSE);
   }
-  free(buff);
-  free(cols);
   wrefresh(win);
 }
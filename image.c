@@ -0,0 +1,353 @@
+// Created by Unium on 18.10.26
+
+// the plot as pixels for the png export. the curves are sampled at the
+// resolution of the image, not the terminal's, and drawn as anti-aliased
+// lines of a width that grows with the image. the image is drawn in bands
+// of rows on the pool, each band on its own, so it comes out the same for
+// any number of threads. the bands go out to the png a strip of them at a
+// time, so the pixels held are a strip's however tall the image is, and
+// the lines are sorted into the bands they cross first so a band only
+// looks at its own
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "maths.h"
+#include "parser.h"
+#include "png.h"
+#include "pool.h"
+#include "types.h"
+
+#define imgBudget 8   // evaluations per pixel column and curve
+#define imgBand 64    // rows per task of the pool
+#define imgPiece 8    // longest piece of a line covered in one box
+
+static int level = -1; // of deflate, zlib's default
+
+const unsigned char d_palette[8][3] = {
+    {16, 16, 16},   {235, 85, 85},  {95, 205, 95},   {230, 200, 70},
+    {90, 140, 245}, {215, 95, 215}, {70, 200, 215},  {230, 230, 230}};
+const unsigned char d_axis_rgb[3] = {60, 110, 120};
+
+// a curve, its points in pixel coordinates with y down
+typedef struct {
+  const Prog *prog;
+  SPoint *pts;
+  int n, col;
+} ICurve;
+
+typedef struct {
+  const PView *v;
+  unsigned char *rgb; // the strip, band0 on
+  float *cov;         // coverage of a curve, zero between uses
+  int w, h, band0;
+  double r; // half the line width
+  ICurve c[mmFuncs];
+  int nc;
+  int *first, *items; // points drawn in band b of curve f start at
+                      // items[first[b * nc + f]]
+  double *fill; // pixel row of f at columns fx0..fx1, NULL for no fill
+  int fx0, fx1, fcol;
+  double fzero;          // the pixel row of y = 0 the fill goes to
+  double zero_x, zero_y; // the axes in pixels, NaN when out of view
+} IJob;
+
+static void sample_task(void *arg, int i) {
+  IJob *j = arg;
+  ICurve *c = &j->c[i];
+  const PView *v = j->v;
+  int evals = 0;
+  c->n = sample_curve(c->prog, v, j->w, j->h, j->w * imgBudget, &c->pts,
+                      &evals);
+  double sx = j->w / (v->mmX - v->mX), sy = j->h / (v->mmY - v->mY);
+  for (int k = 0; k < c->n; k++) {
+    c->pts[k].x = (c->pts[k].x - v->mX) * sx;
+    c->pts[k].y = (v->mmY - c->pts[k].y) * sy;
+  }
+}
+
+// cuts a-b down to the part inside [x0, x1] x [y0, y1], 0 when none is
+int d_clip(double *ax, double *ay, double *bx, double *by, double x0,
+           double y0, double x1, double y1) {
+  double t0 = 0, t1 = 1, dx = *bx - *ax, dy = *by - *ay;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {*ax - x0, x1 - *ax, *ay - y0, y1 - *ay};
+  for (int k = 0; k < 4; k++) {
+    if (p[k] == 0) {
+      if (q[k] < 0)
+        return 0;
+      continue;
+    }
+    double t = q[k] / p[k];
+    if (p[k] < 0)
+      t0 = fmax(t0, t);
+    else
+      t1 = fmin(t1, t);
+  }
+  if (t0 > t1)
+    return 0;
+  double cx = *ax, cy = *ay;
+  *ax = cx + dx * t0;
+  *ay = cy + dy * t0;
+  *bx = cx + dx * t1;
+  *by = cy + dy * t1;
+  return 1;
+}
+
+// from p to the segment a-b
+double d_seg_dist(double px, double py, double ax, double ay, double bx,
+                  double by) {
+  double dx = bx - ax, dy = by - ay, l = dx * dx + dy * dy;
+  double t = l > 0 ? fmax(0, fmin(1, ((px - ax) * dx + (py - ay) * dy) / l))
+                   : 0;
+  return hypot(px - ax - t * dx, py - ay - t * dy);
+}
+
+// coverage of rows y0..y0 + bh, and the box of it that was touched
+typedef struct {
+  float *v;
+  int w, y0, bh;
+  int xa, xb, ya, yb;
+} Cov;
+
+// a line of half width r from a to b into cv. a pixel is covered by how
+// far its centre lies inside the edge, up to a pixel, and keeps the most
+// any line of the curve gave it
+static void cover_line(Cov *cv, double ax, double ay, double bx, double by,
+                       double r) {
+  double m = r + 1;
+  int w = cv->w, y0 = cv->y0, bh = cv->bh;
+  if (!d_clip(&ax, &ay, &bx, &by, -m, y0 - m, w + m, y0 + bh + m))
+    return;
+  // long lines go in short pieces so the boxes stay near the line
+  int n = (int)ceil(hypot(bx - ax, by - ay) / imgPiece);
+  if (n < 1)
+    n = 1;
+  for (int k = 0; k < n; k++) {
+    double px = ax + (bx - ax) * k / n, py = ay + (by - ay) * k / n;
+    double qx = ax + (bx - ax) * (k + 1) / n;
+    double qy = ay + (by - ay) * (k + 1) / n;
+    int xa = (int)floor(fmin(px, qx) - m), xb = (int)ceil(fmax(px, qx) + m);
+    int ya = (int)floor(fmin(py, qy) - m), yb = (int)ceil(fmax(py, qy) + m);
+    if (xa < 0)
+      xa = 0;
+    if (xb > w)
+      xb = w;
+    if (ya < y0)
+      ya = y0;
+    if (yb > y0 + bh)
+      yb = y0 + bh;
+    if (xa >= xb || ya >= yb)
+      continue;
+    cv->xa = xa < cv->xa ? xa : cv->xa;
+    cv->xb = xb > cv->xb ? xb : cv->xb;
+    cv->ya = ya < cv->ya ? ya : cv->ya;
+    cv->yb = yb > cv->yb ? yb : cv->yb;
+    for (int y = ya; y < yb; y++) {
+      float *row = cv->v + (size_t)(y - y0) * w;
+      for (int x = xa; x < xb; x++) {
+        double c = r + 0.5 - d_seg_dist(x + 0.5, y + 0.5, px, py, qx, qy);
+        if (c > row[x])
+          row[x] = c > 1 ? 1 : (float)c;
+      }
+    }
+  }
+}
+
+static void blend(unsigned char *p, const unsigned char *c, double a) {
+  for (int k = 0; k < 3; k++)
+    p[k] = (unsigned char)(p[k] + (c[k] - p[k]) * a + 0.5);
+}
+
+// lays the coverage over the band in colour c and clears it
+static void cover_over(unsigned char *rgb, Cov *cv, const unsigned char *c) {
+  for (int y = cv->ya; y < cv->yb; y++) {
+    size_t row = (size_t)(y - cv->y0) * cv->w;
+    for (int x = cv->xa; x < cv->xb; x++) {
+      float *a = &cv->v[row + x];
+      if (*a > 0)
+        blend(rgb + (row + x) * 3, c, *a);
+      *a = 0;
+    }
+  }
+  cv->xa = cv->ya = INT_MAX;
+  cv->xb = cv->yb = INT_MIN;
+}
+
+// what point i of a curve draws: 1 the line on to the next, 2 a dot as it
+// is joined to neither neighbour, 0 nothing
+static int drawn(const ICurve *c, int i) {
+  const SPoint *p = c->pts;
+  if (!isfinite(p[i].y))
+    return 0;
+  if (i + 1 < c->n && !p[i].brk && isfinite(p[i + 1].y))
+    return 1;
+  return i > 0 && !p[i - 1].brk && isfinite(p[i - 1].y) ? 0 : 2;
+}
+
+// sorts what the curves draw into the bands it reaches, in order of the
+// points within each band and curve. -1 when out of memory
+static int bin(IJob *j) {
+  int nb = (j->h + imgBand - 1) / imgBand, nk = nb * j->nc;
+  j->first = calloc(nk + 1, sizeof(int));
+  if (!j->first)
+    return -1;
+  double m = j->r + 1;
+  // counted in the first pass, placed in the second
+  for (int pass = 0; pass < 2; pass++) {
+    for (int f = 0; f < j->nc; f++) {
+      const ICurve *c = &j->c[f];
+      for (int i = 0; i < c->n; i++) {
+        int d = drawn(c, i);
+        if (!d)
+          continue;
+        const SPoint *a = &c->pts[i], *b = d == 1 ? a + 1 : a;
+        if (fmax(a->x, b->x) < -m || fmin(a->x, b->x) > j->w + m)
+          continue;
+        double lo = fmax(fmin(a->y, b->y) - m, 0);
+        double hi = fmin(fmax(a->y, b->y) + m, j->h - 1);
+        for (int k = (int)lo / imgBand; lo <= hi && k <= (int)hi / imgBand;
+             k++) {
+          if (pass)
+            j->items[j->first[k * j->nc + f]++] = i;
+          else
+            j->first[k * j->nc + f + 1]++;
+        }
+      }
+    }
+    if (pass)
+      break;
+    for (int k = 0; k < nk; k++)
+      j->first[k + 1] += j->first[k];
+    j->items = malloc((j->first[nk] ? j->first[nk] : 1) * sizeof(int));
+    if (!j->items)
+      return -1;
+  }
+  // placing moved every start to the next one's, put them back
+  memmove(j->first + 1, j->first, nk * sizeof(int));
+  j->first[0] = 0;
+  return 0;
+}
+
+// band band0 + i, rows imgBand on from there: the background, the fill,
+// the axes and then the curves in order
+static void band_task(void *arg, int i) {
+  IJob *j = arg;
+  int w = j->w, b = j->band0 + i, y0 = b * imgBand;
+  int bh = j->h - y0 < imgBand ? j->h - y0 : imgBand;
+  unsigned char *rgb = j->rgb + (size_t)i * imgBand * w * 3;
+  Cov cv = {j->cov + (size_t)i * imgBand * w, w, y0, bh,
+            INT_MAX, INT_MIN, INT_MAX, INT_MIN};
+  for (int x = 0; x < w; x++)
+    memcpy(rgb + x * 3, d_palette[0], 3);
+  for (int y = 1; y < bh; y++)
+    memcpy(rgb + (size_t)y * w * 3, rgb, (size_t)w * 3);
+
+  // each pixel of the fill by how much of its height is between f and 0
+  for (int px = j->fx0; j->fill && px <= j->fx1; px++) {
+    double fy = j->fill[px - j->fx0];
+    if (!isfinite(fy))
+      continue;
+    double lo = fmax(fmin(fy, j->fzero), y0);
+    double hi = fmin(fmax(fy, j->fzero), y0 + bh);
+    for (int y = (int)floor(lo); y < hi; y++) {
+      double a = fmin(hi, y + 1) - fmax(lo, y);
+      if (a > 0)
+        blend(rgb + ((size_t)(y - y0) * w + px) * 3, d_palette[j->fcol],
+              a * fillAlpha);
+    }
+  }
+
+  if (isfinite(j->zero_y))
+    cover_line(&cv, -1, j->zero_y, w + 1, j->zero_y, 0.5);
+  if (isfinite(j->zero_x))
+    cover_line(&cv, j->zero_x, -1, j->zero_x, j->h + 1, 0.5);
+  cover_over(rgb, &cv, d_axis_rgb);
+
+  for (int f = 0; f < j->nc; f++) {
+    const ICurve *c = &j->c[f];
+    int k = b * j->nc + f;
+    for (int *it = j->items + j->first[k]; it < j->items + j->first[k + 1];
+         it++) {
+      const SPoint *p = &c->pts[*it], *q = drawn(c, *it) == 1 ? p + 1 : p;
+      cover_line(&cv, p->x, p->y, q->x, q->y, j->r);
+    }
+    cover_over(rgb, &cv, d_palette[c->col & 7]);
+  }
+}
+
+// of the curves in an image h pixels tall
+double d_line_width(int h) { return fmax(1.5, h / 720.0); }
+
+// 0 to 9, from fastest to smallest
+void d_png_level(int l) { level = l; }
+
+int export_png(const char *f_name, const PScene *s, int w, int h) {
+  if (w <= 0 || h <= 0)
+    return -1;
+  const FLists *funcs = &s->funcs;
+  const PView *v = &s->v;
+  IJob j = {.v = v, .w = w, .h = h, .r = d_line_width(h) / 2};
+  double sx = w / (v->mmX - v->mX), sy = h / (v->mmY - v->mY);
+  j.zero_x = 0 >= v->mX && 0 <= v->mmX ? -v->mX * sx : NAN;
+  j.zero_y = 0 >= v->mY && 0 <= v->mmY ? v->mmY * sy : NAN;
+
+  for (int f = 0; f < funcs->count; f++) {
+    const F *fn = &funcs->functions[f];
+    if (fn->active && fn->prog)
+      j.c[j.nc++] = (ICurve){fn->prog, NULL, 0, fn->col};
+  }
+  t_for(j.nc, sample_task, &j);
+
+  // the fill is f at the centres of the columns in [a, b]
+  const F *sel = funcs->count ? &funcs->functions[funcs->sel] : NULL;
+  if (s->integ.active && sel && sel->prog) {
+    double a = (fmin(s->integ.a, s->integ.b) - v->mX) * sx;
+    double b = (fmax(s->integ.a, s->integ.b) - v->mX) * sx;
+    j.fx0 = (int)fmax(0, ceil(a - 0.5));
+    j.fx1 = (int)fmin(w - 1, floor(b - 0.5));
+    int n = j.fx1 - j.fx0 + 1;
+    double *xs = n > 0 ? malloc(n * sizeof(double)) : NULL;
+    j.fill = n > 0 ? malloc(n * sizeof(double)) : NULL;
+    if (xs && j.fill) {
+      for (int i = 0; i < n; i++)
+        xs[i] = v->mX + (j.fx0 + i + 0.5) / sx;
+      p_batch(sel->prog, xs, j.fill, n);
+      for (int i = 0; i < n; i++)
+        j.fill[i] = (v->mmY - j.fill[i]) * sy;
+    } else {
+      free(j.fill);
+      j.fill = NULL;
+    }
+    free(xs);
+    j.fzero = v->mmY * sy;
+    j.fcol = sel->col & 7;
+  }
+
+  // a strip is a band per thread
+  int nb = (h + imgBand - 1) / imgBand, per = t_threads();
+  j.rgb = malloc((size_t)w * imgBand * per * 3);
+  j.cov = calloc((size_t)w * imgBand * per, sizeof(float));
+  int err = !j.rgb || !j.cov || bin(&j) != 0;
+  PngW *png = err ? NULL : png_open(f_name, w, h, level);
+  err |= !png;
+  for (j.band0 = 0; !err && j.band0 < nb; j.band0 += per) {
+    int n = nb - j.band0 < per ? nb - j.band0 : per;
+    t_for(n, band_task, &j);
+    int rows = h - j.band0 * imgBand;
+    err = png_rows(png, j.rgb, rows < n * imgBand ? rows : n * imgBand);
+  }
+  if (png)
+    err |= png_close(png) != 0;
+  for (int f = 0; f < j.nc; f++)
+    free(j.c[f].pts);
+  free(j.fill);
+  free(j.rgb);
+  free(j.cov);
+  free(j.first);
+  free(j.items);
+  return err ? -1 : 0;
+}
@@ -0,0 +1,26 @@
+// Created by Unium on 18.10.26
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "types.h"
+
+#define fillAlpha 0.3 // of the integration fill
+
+// the background, then the colour pairs of the terminal
+extern const unsigned char d_palette[8][3];
+extern const unsigned char d_axis_rgb[3];
+
+// the plot of s as a w x h pixel png, drawn at that size. the formulas of
+// s must be compiled. 0 when written
+int export_png(const char *f_name, const PScene *s, int w, int h);
+void d_png_level(int level);
+double d_line_width(int h);
+
+// geometry of the exporters
+int d_clip(double *ax, double *ay, double *bx, double *by, double x0,
+           double y0, double x1, double y1);
+double d_seg_dist(double px, double py, double ax, double ay, double bx,
+                  double by);
+
+#endif // !IMAGE_H
@@ -0,0 +1,294 @@
+// Created by Unium on 18.10.26
+
+// interval arithmetic over compiled formulas. p_ival gives an enclosure of
+// f over [lo, hi]: every finite value the interpreter produces for an x in
+// the range lies inside it. samples that come out NaN (domain or error) are
+// not part of it, so a range where f is nowhere defined is empty.
+// rounding is monotone, so the correctly rounded ops (+ - * / sqrt and the
+// interpreter's own multiply chain for powi) bound it exactly from the
+// ends. libm and the kernels are only close, those results are widened by
+// a few ulp
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "types.h"
+
+static const Ival empty = {INFINITY, -INFINITY};
+static const Ival whole = {-INFINITY, INFINITY};
+
+static int is_empty(Ival a) { return !(a.lo <= a.hi); }
+
+static Ival iv(double lo, double hi) { return (Ival){lo, hi}; }
+
+// a NaN bound (inf - inf, inf / inf) opens up to infinity
+static Ival fix(Ival r) {
+  return iv(isnan(r.lo) ? -INFINITY : r.lo, isnan(r.hi) ? INFINITY : r.hi);
+}
+
+// outward by ulps
+static Ival widen(Ival r, int ulps) {
+  r = fix(r);
+  if (isfinite(r.lo))
+    r.lo -= fabs(r.lo) * ulps * DBL_EPSILON + DBL_TRUE_MIN;
+  if (isfinite(r.hi))
+    r.hi += fabs(r.hi) * ulps * DBL_EPSILON + DBL_TRUE_MIN;
+  return r;
+}
+
+static Ival hull(Ival a, Ival b) {
+  if (is_empty(a))
+    return b;
+  if (is_empty(b))
+    return a;
+  return iv(fmin(a.lo, b.lo), fmax(a.hi, b.hi));
+}
+
+static Ival meet(Ival a, double lo, double hi) {
+  return iv(fmax(a.lo, lo), fmin(a.hi, hi));
+}
+
+// smallest and largest of the four corner results
+static Ival corners(double p0, double p1, double p2, double p3) {
+  return fix(iv(fmin(fmin(p0, p1), fmin(p2, p3)),
+                fmax(fmax(p0, p1), fmax(p2, p3))));
+}
+
+// products where 0 * inf counts as 0, the limit the interpreter never hits
+static double mul0(double a, double b) { return a == 0 || b == 0 ? 0 : a * b; }
+
+static Ival imul(Ival a, Ival b) {
+  return corners(mul0(a.lo, b.lo), mul0(a.lo, b.hi), mul0(a.hi, b.lo),
+                 mul0(a.hi, b.hi));
+}
+
+// a / b for a b that stays clear of zero
+static Ival idiv1(Ival a, Ival b) {
+  return corners(a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi);
+}
+
+// the interpreter fails a division by anything under 1e-15, so only the
+// parts of b outside (-1e-15, 1e-15) count
+static Ival idiv(Ival a, Ival b) {
+  Ival r = empty;
+  if (b.lo <= -1e-15)
+    r = hull(r, idiv1(a, iv(b.lo, fmin(b.hi, -1e-15))));
+  if (b.hi >= 1e-15)
+    r = hull(r, idiv1(a, iv(fmax(b.lo, 1e-15), b.hi)));
+  return r;
+}
+
+static Ival imod(Ival a, Ival b) {
+  if (b.lo > -1e-15 && b.hi < 1e-15)
+    return empty;
+  // fmod keeps the sign of a and stays under |b|. within one period of a
+  // fixed b it is a - k*b for a fixed k
+  double m = fmax(fabs(b.lo), fabs(b.hi));
+  if (b.lo == b.hi && (a.lo >= 0 || a.hi <= 0)) {
+    double fl = fmod(a.lo, m), fh = fmod(a.hi, m);
+    if (trunc(a.lo / m) == trunc(a.hi / m) && fl <= fh)
+      return iv(fl, fh);
+  }
+  return iv(a.lo < 0 ? fmax(a.lo, -m) : 0, a.hi > 0 ? fmin(a.hi, m) : 0);
+}
+
+// a^k for a whole k > 0 through f, even powers fold the negative side over
+static Ival ipowi(Ival a, double k, double (*f)(double, double)) {
+  double l = f(a.lo, k), h = f(a.hi, k);
+  if (fmod(k, 2) != 0 || a.lo >= 0)
+    return fix(iv(l, h));
+  if (a.hi <= 0)
+    return fix(iv(h, l));
+  return fix(iv(0, fmax(l, h)));
+}
+
+// the interpreter's square and multiply
+static double chain(double a, double k) {
+  int e = 0;
+  return p_op(oPOWI, a, k, &e);
+}
+
+// 1/d the way pow divides, by anything including 0
+static Ival recip(Ival d) {
+  if (d.lo > 0 || d.hi < 0)
+    return widen(iv(1 / d.hi, 1 / d.lo), 1);
+  if (d.lo == 0 && d.hi > 0)
+    return widen(iv(1 / d.hi, INFINITY), 1);
+  if (d.hi == 0 && d.lo < 0)
+    return widen(iv(-INFINITY, 1 / d.lo), 1);
+  return whole;
+}
+
+static Ival ipow(Ival a, Ival b) {
+  if (b.lo == b.hi && b.lo == floor(b.lo)) {
+    if (b.lo == 0)
+      return iv(1, 1);
+    Ival r = widen(ipowi(a, fabs(b.lo), pow), 2);
+    return b.lo > 0 ? r : recip(r);
+  }
+  // a negative base is defined at integer exponents only, which a spread
+  // b can pass through anywhere
+  if (a.lo < 0 && b.lo != b.hi)
+    return whole;
+  a = meet(a, 0, INFINITY);
+  if (is_empty(a))
+    return empty;
+  // b ln a is monotone in each argument, so the corners bound it
+  return widen(corners(pow(a.lo, b.lo), pow(a.lo, b.hi), pow(a.hi, b.lo),
+                       pow(a.hi, b.hi)),
+               2);
+}
+
+// defined at the integers 0..170 only, where it increases. the ends go
+// through p_op so they are the interpreter's own values
+static Ival ifact(Ival a) {
+  double lo = ceil(fmax(a.lo, 0)), hi = floor(fmin(a.hi, 170));
+  if (lo > hi)
+    return empty;
+  int e = 0;
+  return iv(p_op(oFACT, lo, 0, &e), p_op(oFACT, hi, 0, &e));
+}
+
+// sin over a, shifted by s quarter turns (1 gives cos)
+static Ival isin(Ival a, int s) {
+  if (a.hi - a.lo >= 2 * M_PI || fabs(a.lo) > 1e9 || fabs(a.hi) > 1e9)
+    return iv(-1, 1);
+  double fl = s ? cos(a.lo) : sin(a.lo), fh = s ? cos(a.hi) : sin(a.hi);
+  Ival r = widen(iv(fmin(fl, fh), fmax(fl, fh)), 2);
+  // the peaks sit at (4k + 1 - s) pi/2, the troughs at (4k + 3 - s) pi/2.
+  // the range is taken loosely so a peak on the edge is kept
+  double q0 = ceil(a.lo / M_PI_2 - 1e-9), q1 = floor(a.hi / M_PI_2 + 1e-9);
+  for (double q = q0; q <= q1; q++) {
+    long m = ((long)q + s) & 3;
+    if (m == 1)
+      r.hi = 1;
+    else if (m == 3)
+      r.lo = -1;
+  }
+  return meet(r, -1, 1);
+}
+
+static Ival itan(Ival a) {
+  if (a.hi - a.lo >= M_PI || fabs(a.lo) > 1e9 || fabs(a.hi) > 1e9)
+    return whole;
+  // a pole at (k + 1/2) pi anywhere in range, again taken loosely
+  if (floor(a.lo / M_PI + 0.5 - 1e-9) != floor(a.hi / M_PI + 0.5 + 1e-9))
+    return whole;
+  return widen(iv(tan(a.lo), tan(a.hi)), 2);
+}
+
+// increasing f on the part of a inside its domain
+static Ival mono(double (*f)(double), Ival a, double lo, double hi) {
+  a = meet(a, lo, hi);
+  if (is_empty(a))
+    return empty;
+  Ival r = iv(f(a.lo), f(a.hi));
+  return f == sqrt ? r : widen(r, 2);
+}
+
+static Ival un(Op op, Ival a, double v) {
+  switch (op) {
+  case oNEG:
+    return iv(-a.hi, -a.lo);
+  case oPOWI:
+    return ipowi(a, v, chain);
+  case oFACT:
+    return ifact(a);
+  case oABS:
+    if (a.lo >= 0)
+      return a;
+    if (a.hi <= 0)
+      return iv(-a.hi, -a.lo);
+    return iv(0, fmax(-a.lo, a.hi));
+  case oSQRT:
+    return mono(sqrt, a, 0, INFINITY);
+  case oEXP:
+    return mono(exp, a, -INFINITY, INFINITY);
+  case oLN:
+    return mono(log, a, 0, INFINITY);
+  case oLOG:
+    return mono(log10, a, 0, INFINITY);
+  case oASIN:
+    return mono(asin, a, -1, 1);
+  case oACOS:
+    a = meet(a, -1, 1);
+    return is_empty(a) ? empty : widen(iv(acos(a.hi), acos(a.lo)), 2);
+  case oATAN:
+    return mono(atan, a, -INFINITY, INFINITY);
+  case oSINH:
+    return mono(sinh, a, -INFINITY, INFINITY);
+  case oTANH:
+    return mono(tanh, a, -INFINITY, INFINITY);
+  case oCOSH: {
+    double m = fmax(fabs(a.lo), fabs(a.hi));
+    double n = a.lo <= 0 && a.hi >= 0 ? 0 : fmin(fabs(a.lo), fabs(a.hi));
+    return widen(iv(cosh(n), cosh(m)), 2);
+  }
+  case oSIN:
+    return isin(a, 0);
+  case oCOS:
+    return isin(a, 1);
+  case oTAN:
+    return itan(a);
+  case oFLOOR:
+    return iv(floor(a.lo), floor(a.hi));
+  case oCEIL:
+    return iv(ceil(a.lo), ceil(a.hi));
+  default:
+    return whole;
+  }
+}
+
+static Ival bin(Op op, Ival a, Ival b) {
+  switch (op) {
+  case oADD:
+    return fix(iv(a.lo + b.lo, a.hi + b.hi));
+  case oSUB:
+    return fix(iv(a.lo - b.hi, a.hi - b.lo));
+  case oMUL:
+    return imul(a, b);
+  case oDIV:
+    return idiv(a, b);
+  case oMOD:
+    return imod(a, b);
+  case oPOW:
+    return ipow(a, b);
+  default:
+    return whole;
+  }
+}
+
+Ival p_ival(const Prog *pg, double lo, double hi) {
+  if (!pg || pg->len == 0)
+    return empty;
+
+  Ival buf[64];
+  Ival *st = pg->depth <= 64 ? buf : malloc(pg->depth * sizeof(Ival));
+  if (!st)
+    return whole;
+  int sp = 0;
+  st[0] = empty;
+
+  for (int i = 0; i < pg->len; i++) {
+    const CInstr *in = &pg->code[i];
+    if (in->op == oNUM) {
+      st[sp++] = iv(in->v, in->v);
+    } else if (in->op == oX) {
+      st[sp++] = iv(lo, hi);
+    } else if (in->op >= oADD && in->op <= oPOW) {
+      sp--;
+      st[sp - 1] = is_empty(st[sp - 1]) || is_empty(st[sp])
+                       ? empty
+                       : bin(in->op, st[sp - 1], st[sp]);
+    } else if (!is_empty(st[sp - 1])) {
+      st[sp - 1] = un(in->op, st[sp - 1], in->v);
+    }
+  }
+
+  Ival r = st[0];
+  if (st != buf)
+    free(st);
+  return is_empty(r) ? empty : r;
+}
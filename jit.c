@@ -0,0 +1,321 @@
+// Created by Unium on 18.10.26
+
+// native code for a compiled formula. the program keeps the interpreter's
+// block layout (one 64 sample row of the stack per entry) but runs of
+// arithmetic between two calls become a single loop over the block, two
+// samples at a time in packed sse2 doubles with the top of the stack in
+// xmm0. add/sub/mul/div/neg/abs/sqrt/powi (and floor/ceil with sse4.1) are
+// emitted inline, every other op is one call per block to j_call, which
+// hands the row to the batch kernels or to libm through p_op
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kern.h"
+#include "parser.h"
+#include "types.h"
+
+#define pBlock 64
+
+static int jit_on = 1;
+
+void p_jit_enable(int on) { jit_on = on; }
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+// xs and st hold n samples (a multiple of 4), the result ends up in row 0
+typedef void (*JFn)(const double *xs, double *st, long n, uint64_t *err);
+
+typedef struct {
+  uint8_t *p;
+  int len;
+} Jb;
+
+static void b(Jb *j, int n, ...) {
+  va_list ap;
+  va_start(ap, n);
+  for (int i = 0; i < n; i++)
+    j->p[j->len++] = (uint8_t)va_arg(ap, int);
+  va_end(ap);
+}
+
+static void b32(Jb *j, uint32_t v) {
+  memcpy(j->p + j->len, &v, 4);
+  j->len += 4;
+}
+
+static void b64(Jb *j, uint64_t v) {
+  memcpy(j->p + j->len, &v, 8);
+  j->len += 8;
+}
+
+static uint64_t bits(double v) {
+  uint64_t u;
+  memcpy(&u, &v, 8);
+  return u;
+}
+
+static int row(int k) { return k * pBlock * (int)sizeof(double); }
+
+// op xmm(d), xmm(s) for the 66 0f packed double ops
+static void pd(Jb *j, int op, int d, int s) {
+  b(j, 4, 0x66, 0x0f, op, 0xc0 | d << 3 | s);
+}
+
+// movapd xmm(r) <-> [r13 + rbx*8 + off], the current pair of a stack row
+static void ld(Jb *j, int r, int off) {
+  b(j, 6, 0x66, 0x41, 0x0f, 0x28, 0x84 | r << 3, 0xdd);
+  b32(j, off);
+}
+
+static void st(Jb *j, int r, int off) {
+  b(j, 6, 0x66, 0x41, 0x0f, 0x29, 0x84 | r << 3, 0xdd);
+  b32(j, off);
+}
+
+// xmm(r) = {v, v}, through rax
+static void splat(Jb *j, int r, uint64_t v) {
+  b(j, 2, 0x48, 0xb8);
+  b64(j, v);
+  b(j, 5, 0x66, 0x48, 0x0f, 0x6e, 0xc0 | r << 3); // movq xmm(r), rax
+  pd(j, 0x14, r, r);
+}
+
+static int binary(Op op) { return op >= oADD && op <= oPOW; }
+
+static int push(Op op) { return op == oNUM || op == oX; }
+
+static int inline_op(Op op, int round) {
+  switch (op) {
+  case oNUM:
+  case oX:
+  case oADD:
+  case oSUB:
+  case oMUL:
+  case oDIV:
+  case oNEG:
+  case oABS:
+  case oSQRT:
+  case oPOWI:
+    return 1;
+  case oFLOOR:
+  case oCEIL:
+    return round;
+  default:
+    return 0;
+  }
+}
+
+// one op over a whole row, the same as the interpreter's fallback
+static void j_call(Op op, double *a, const double *r, long n, double v,
+                   uint64_t *err) {
+  const Kern *k = k_get();
+  if (binary(op) ? k->bin(op, a, r, n, err) : k->un(op, a, n, v))
+    return;
+  for (int j = 0; j < n; j++) {
+    int e = 0;
+    a[j] = p_op(op, a[j], binary(op) ? r[j] : v, &e);
+    if (e)
+      *err |= (uint64_t)1 << j;
+  }
+}
+
+static void call(Jb *j, Op op, int sp, double v) {
+  int a = row(sp - (binary(op) ? 2 : 1));
+  b(j, 1, 0xbf); // mov edi, op
+  b32(j, op);
+  b(j, 3, 0x49, 0x8d, 0xb5); // lea rsi, [r13 + a]
+  b32(j, a);
+  b(j, 3, 0x49, 0x8d, 0x95); // lea rdx, [r13 + a + row]
+  b32(j, a + row(1));
+  b(j, 3, 0x4c, 0x89, 0xf1); // mov rcx, r14
+  b(j, 3, 0x4d, 0x89, 0xf8); // mov r8, r15
+  splat(j, 0, bits(v));
+  b(j, 2, 0x48, 0xb8); // mov rax, j_call
+  b64(j, (uint64_t)(uintptr_t)j_call);
+  b(j, 2, 0xff, 0xd0); // call rax
+}
+
+// one inline op on the pair in xmm0, the rows below it stay in memory
+static void op2(Jb *j, const CInstr *in, int sp) {
+  Op op = in->op;
+  switch (op) {
+  case oNUM:
+  case oX:
+    if (sp > 0)
+      st(j, 0, row(sp - 1));
+    if (op == oNUM)
+      splat(j, 0, bits(in->v));
+    else
+      b(j, 6, 0x66, 0x41, 0x0f, 0x10, 0x04, 0xdc); // movupd xmm0, [r12 + rbx*8]
+    break;
+  case oADD:
+  case oSUB:
+  case oMUL:
+  case oDIV:
+    pd(j, 0x28, 1, 0); // movapd xmm1, xmm0
+    ld(j, 0, row(sp - 2));
+    if (op == oDIV) {
+      // err |= movmsk(|r| < 1e-15) << rbx
+      pd(j, 0x28, 2, 1);
+      splat(j, 3, 0x7fffffffffffffffULL);
+      pd(j, 0x54, 2, 3);
+      splat(j, 3, bits(1e-15));
+      pd(j, 0xc2, 2, 3);
+      b(j, 1, 1);                      // cmpltpd
+      b(j, 4, 0x66, 0x0f, 0x50, 0xc2); // movmskpd eax, xmm2
+      b(j, 2, 0x89, 0xd9);             // mov ecx, ebx
+      b(j, 3, 0x48, 0xd3, 0xe0);       // shl rax, cl
+      b(j, 3, 0x49, 0x09, 0x07);       // or [r15], rax
+    }
+    pd(j, op == oADD   ? 0x58
+          : op == oSUB ? 0x5c
+          : op == oMUL ? 0x59
+                       : 0x5e,
+       0, 1);
+    break;
+  case oNEG:
+    splat(j, 3, 0x8000000000000000ULL);
+    pd(j, 0x57, 0, 3);
+    break;
+  case oABS:
+    splat(j, 3, 0x7fffffffffffffffULL);
+    pd(j, 0x54, 0, 3);
+    break;
+  case oSQRT:
+    // below zero the interpreter's positive NaN, not sqrtpd's negative one
+    pd(j, 0x28, 1, 0);
+    pd(j, 0x51, 0, 0); // sqrtpd
+    pd(j, 0x57, 2, 2);
+    pd(j, 0xc2, 1, 2);
+    b(j, 1, 1); // cmpltpd
+    splat(j, 3, bits(__builtin_nan("")));
+    pd(j, 0x54, 3, 1); // andpd
+    pd(j, 0x55, 1, 0); // andnpd
+    pd(j, 0x56, 1, 3); // orpd
+    pd(j, 0x28, 0, 1);
+    break;
+  case oPOWI:
+    // the same square and multiply order as the interpreter
+    splat(j, 1, bits(1.0));
+    for (int k = (int)in->v; k; k >>= 1) {
+      if (k & 1)
+        pd(j, 0x59, 1, 0);
+      if (k > 1)
+        pd(j, 0x59, 0, 0);
+    }
+    pd(j, 0x28, 0, 1);
+    break;
+  default: // floor, ceil with roundpd
+    b(j, 6, 0x66, 0x0f, 0x3a, 0x09, 0xc0, op == oFLOOR ? 9 : 10);
+    break;
+  }
+}
+
+static void emit(Jb *j, const Prog *pg, int round) {
+  int sp = 0;
+  for (int i = 0; i < pg->len;) {
+    const CInstr *in = &pg->code[i];
+    if (!inline_op(in->op, round)) {
+      call(j, in->op, sp, in->v);
+      sp -= binary(in->op);
+      i++;
+      continue;
+    }
+
+    // a loop over the block for the run of inline ops starting here
+    b(j, 2, 0x31, 0xdb); // xor ebx, ebx
+    int top = j->len;
+    int s = sp;
+    if (s > 0)
+      ld(j, 0, row(s - 1));
+    int k = i;
+    for (; k < pg->len && inline_op(pg->code[k].op, round); k++) {
+      op2(j, &pg->code[k], s);
+      s += push(pg->code[k].op) - binary(pg->code[k].op);
+    }
+    st(j, 0, row(s - 1));
+    b(j, 4, 0x48, 0x83, 0xc3, 0x02); // add rbx, 2
+    b(j, 3, 0x4c, 0x39, 0xf3);       // cmp rbx, r14
+    b(j, 2, 0x0f, 0x8c);             // jl top
+    b32(j, top - (j->len + 4));
+    sp = s;
+    i = k;
+  }
+}
+
+// compiles pg to native code, 0 on success. -1 leaves pg on the interpreter
+int p_jit(Prog *pg) {
+  if (!jit_on || !pg || pg->len == 0 || pg->jit)
+    return -1;
+  __builtin_cpu_init();
+  int round = __builtin_cpu_supports("sse4.1");
+
+  // no instruction emits more than 100 bytes, and each loop adds 40
+  size_t cap = 256 + (size_t)pg->len * 160;
+  uint8_t *mem = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return -1;
+  Jb j = {mem, 0};
+
+  // push rbx, r12-r15, which also leaves rsp 16 aligned for the calls
+  b(&j, 9, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+  b(&j, 12, 0x49, 0x89, 0xfc, 0x49, 0x89, 0xf5, 0x49, 0x89, 0xd6, 0x49, 0x89,
+    0xcf);
+  emit(&j, pg, round);
+  b(&j, 10, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3);
+
+  if (mprotect(mem, cap, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, cap);
+    return -1;
+  }
+  pg->jit = mem;
+  pg->jit_len = cap;
+  return 0;
+}
+
+void p_jit_free(Prog *pg) {
+  if (pg->jit)
+    munmap(pg->jit, pg->jit_len);
+  pg->jit = NULL;
+}
+
+// one block of m <= 64 samples, st as for the interpreter. the loops run
+// whole vectors, so x is copied out with its padding zeroed rather than
+// read past the end of xs
+void p_jit_run(const Prog *pg, const double *xs, double *ys, int m,
+               double *st) {
+  double xb[pBlock] = {0};
+  uint64_t err = 0;
+  memcpy(xb, xs, m * sizeof(double));
+  ((JFn)pg->jit)(xb, st, (m + 3) & ~3, &err);
+  for (int j = 0; j < m; j++)
+    ys[j] = (err >> j) & 1 ? NAN : st[j];
+}
+
+#else
+
+int p_jit(Prog *pg) {
+  (void)pg;
+  return -1;
+}
+
+void p_jit_free(Prog *pg) { pg->jit = NULL; }
+
+void p_jit_run(const Prog *pg, const double *xs, double *ys, int m,
+               double *st) {
+  (void)pg;
+  (void)xs;
+  (void)ys;
+  (void)m;
+  (void)st;
+}
+
+#endif
@@ -0,0 +1,113 @@
+// Created by Unium on 18.10.26
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kern.h"
+#include "types.h"
+
+static int scalar_bin(Op op, double *l, const double *r, int n,
+                      uint64_t *err) {
+  switch (op) {
+  case oADD:
+    for (int j = 0; j < n; j++)
+      l[j] += r[j];
+    return 1;
+  case oSUB:
+    for (int j = 0; j < n; j++)
+      l[j] -= r[j];
+    return 1;
+  case oMUL:
+    for (int j = 0; j < n; j++)
+      l[j] *= r[j];
+    return 1;
+  case oDIV:
+    for (int j = 0; j < n; j++) {
+      if (fabs(r[j]) < 1e-15)
+        *err |= (uint64_t)1 << j;
+      l[j] /= r[j];
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int scalar_un(Op op, double *a, int n, double v) {
+  switch (op) {
+  case oNEG:
+    for (int j = 0; j < n; j++)
+      a[j] = -a[j];
+    return 1;
+  case oABS:
+    for (int j = 0; j < n; j++)
+      a[j] = fabs(a[j]);
+    return 1;
+  case oPOWI:
+    for (int j = 0; j < n; j++) {
+      double r = 1.0, b = a[j];
+      for (int k = (int)v; k; k >>= 1) {
+        if (k & 1)
+          r *= b;
+        b *= b;
+      }
+      a[j] = r;
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+const Kern k_scalar = {"scalar", scalar_bin, scalar_un};
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// the same kernel source is built once per instruction set, only the vector
+// width and a few intrinsics differ. no fma so both give identical bits
+
+#define kW 2
+#define kSFX(n) n##_sse2
+#define kTARGET
+#define kSQRT(v) ((V)_mm_sqrt_pd((__m128d)(v)))
+#define kMASK(m) _mm_movemask_pd((__m128d)(m))
+#include "kern_impl.h"
+#undef kW
+#undef kSFX
+#undef kTARGET
+#undef kSQRT
+#undef kMASK
+
+#define kW 4
+#define kSFX(n) n##_avx2
+#define kTARGET __attribute__((target("avx2")))
+#define kSQRT(v) ((V)_mm256_sqrt_pd((__m256d)(v)))
+#define kMASK(m) _mm256_movemask_pd((__m256d)(m))
+#include "kern_impl.h"
+#undef kW
+#undef kSFX
+#undef kTARGET
+#undef kSQRT
+#undef kMASK
+
+const Kern k_sse2 = {"sse2", bin_sse2, un_sse2};
+const Kern k_avx2 = {"avx2", bin_avx2, un_avx2};
+#endif
+
+static const Kern *k;
+
+void k_set(const Kern *set) { k = set; }
+
+const Kern *k_get(void) {
+  if (k)
+    return k;
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  k = __builtin_cpu_supports("avx2") ? &k_avx2 : &k_sse2;
+#else
+  k = &k_scalar;
+#endif
+  return k;
+}
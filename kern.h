@@ -0,0 +1,30 @@
+// Created by Unium on 18.10.26
+
+#ifndef KERN_H
+#define KERN_H
+
+#include "types.h"
+#include <stdint.h>
+
+// block kernels for the batch evaluator, n is a multiple of 4 and lanes past
+// the live ones are scratch. bin/un return 0 for ops they leave to the scalar
+// path. err gets bit j set when lane j divides by ~0, v is the immediate of
+// unary ops like oPOWI
+
+typedef struct {
+  const char *name;
+  int (*bin)(Op op, double *l, const double *r, int n, uint64_t *err);
+  int (*un)(Op op, double *a, int n, double v);
+} Kern;
+
+extern const Kern k_scalar;
+#if defined(__x86_64__)
+extern const Kern k_sse2;
+extern const Kern k_avx2;
+#endif
+
+// best set for this cpu unless k_set picked one
+const Kern *k_get(void);
+void k_set(const Kern *k);
+
+#endif // !KERN_H
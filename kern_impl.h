@@ -0,0 +1,307 @@
+// Created by Unium on 18.10.26
+
+// vector kernel body, included by kern.c once per instruction set with
+// kW (lanes), kSFX (name suffix), kTARGET, kSQRT and kMASK defined.
+// exp/log/sin/cos follow the cephes double routines
+
+#define V kSFX(vd)
+#define VI kSFX(vi)
+#define VU kSFX(vu)
+#define S(n) kSFX(n)
+#define kINL static inline __attribute__((always_inline)) kTARGET
+
+typedef double V __attribute__((vector_size(kW * 8)));
+typedef int64_t VI __attribute__((vector_size(kW * 8)));
+typedef uint64_t VU __attribute__((vector_size(kW * 8)));
+
+kINL V S(ld)(const double *p) {
+  V v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+kINL void S(st)(double *p, V v) { memcpy(p, &v, sizeof v); }
+
+kINL V S(sel)(VI m, V a, V b) { return (V)((m & (VI)a) | (~m & (VI)b)); }
+
+kINL V S(fabs)(V x) { return (V)((VU)x & 0x7fffffffffffffffULL); }
+
+// integral part rounding for |x| < 2^52, larger values already are integers
+kINL V S(rint)(V x) {
+  V ax = S(fabs)(x);
+  V r = (ax + 0x1p52) - 0x1p52;
+  r = (V)((VU)r | ((VU)x & 0x8000000000000000ULL));
+  return S(sel)(ax >= 0x1p52, x, r);
+}
+
+kINL V S(floor)(V x) {
+  V r = S(rint)(x);
+  r = S(sel)(r > x, r - 1.0, r);
+  return (V)((VU)r | ((VU)x & 0x8000000000000000ULL));
+}
+
+kINL V S(ceil)(V x) {
+  V r = S(rint)(x);
+  r = S(sel)(r < x, r + 1.0, r);
+  return (V)((VU)r | ((VU)x & 0x8000000000000000ULL));
+}
+
+// 2^k for integral |k| <= 1023
+kINL V S(pow2)(V k) {
+  VI n = (VI)(k + 0x1.8p52) - (VI)((V){0} + 0x1.8p52);
+  return (V)((n + 1023) << 52);
+}
+
+kINL V S(exp)(V x) {
+  V c = S(sel)(x > 710.0, (V){0} + 710.0, x);
+  c = S(sel)(c < -746.0, (V){0} - 746.0, c);
+  V k = (c * 1.4426950408889634073599 + 0x1.8p52) - 0x1.8p52;
+  V r = c - k * 6.93145751953125E-1;
+  r = r - k * 1.42860682030941723212E-6;
+  V rr = r * r;
+  V px = r * ((1.26177193074810590878E-4 * rr + 3.02994407707441961300E-2) *
+                  rr +
+              9.99999999999999999910E-1);
+  V q = ((3.00198505138664455042E-6 * rr + 2.52448340349684104192E-3) * rr +
+         2.27265548208155028766E-1) *
+            rr +
+        2.00000000000000000009E0;
+  V e = 1.0 + 2.0 * (px / (q - px));
+  // split the scale so subnormal results and 2^1024 still come out right
+  V k1 = (k * 0.5 + 0x1.8p52) - 0x1.8p52;
+  V y = e * S(pow2)(k1) * S(pow2)(k - k1);
+  return S(sel)(x == x, y, x);
+}
+
+kINL V S(log)(V x) {
+  VI sub = x < 0x1p-1022;
+  V xs = S(sel)(sub, x * 0x1p54, x);
+  VU b = (VU)xs;
+  V e = (V)((b >> 52) + (VU)((V){0} + 0x1.8p52)) - 0x1.8p52;
+  e = e - 1022.0 - S(sel)(sub, (V){0} + 54.0, (V){0});
+  V m = (V)((b & 0x000fffffffffffffULL) | 0x3fe0000000000000ULL);
+  VI lo = m < 0.70710678118654752440;
+  e = S(sel)(lo, e - 1.0, e);
+  V t = S(sel)(lo, m + m - 1.0, m - 1.0);
+  V z = t * t;
+  V p = ((((1.01875663804580931796E-4 * t + 4.97494994976747001425E-1) * t +
+           4.70579119878881725854E0) *
+              t +
+          1.44989225341610930846E1) *
+             t +
+         1.79368678507819816313E1) *
+            t +
+        7.70838733755885391666E0;
+  V q = ((((t + 1.12873587189167450590E1) * t + 4.52279145837532221105E1) * t +
+          8.29875266912776603211E1) *
+             t +
+         7.11544750618563894466E1) *
+            t +
+        2.31251620126765340583E1;
+  V y = t * (z * p / q);
+  y = y - e * 2.121944400546905827679e-4;
+  y = y - 0.5 * z;
+  V r = t + y;
+  r = r + e * 0.693359375;
+  r = S(sel)(x == __builtin_inf(), x, r);
+  return S(sel)(x > 0.0, r, (V){0} + __builtin_nan(""));
+}
+
+kINL V S(spoly)(V z, V zz) {
+  return z + z * (zz * (((((1.58962301576546568060E-10 * zz -
+                            2.50507477628578072866E-8) *
+                               zz +
+                           2.75573136213857245213E-6) *
+                              zz -
+                          1.98412698295895385996E-4) *
+                             zz +
+                         8.33333333332211858878E-3) *
+                            zz -
+                        1.66666666666666307295E-1));
+}
+
+kINL V S(cpoly)(V zz) {
+  return 1.0 - 0.5 * zz +
+         zz * zz *
+             (((((-1.13585365213876817300E-11 * zz +
+                  2.08757008419747316778E-9) *
+                     zz -
+                 2.75573141792967388112E-7) *
+                    zz +
+                2.48015872888517045348E-5) *
+                   zz -
+               1.38888888888730564116E-3) *
+                  zz +
+              4.16666666666665929218E-2);
+}
+
+// lane mask from bit 0 of b, via the sign of +-1.0 since sse2 has no 64-bit
+// integer compares
+kINL VI S(bit0)(VU b) { return (V)((b << 63) | 0x3ff0000000000000ULL) < 0.0; }
+
+// sin/cos/tan, |x| is reduced by the nearest multiple q of pi/2 with the
+// cephes three part constants. lanes past the reduction's range go to libm
+kINL void S(trig)(Op op, double *a) {
+  V x = S(ld)(a);
+  V ax = S(fabs)(x);
+  V t = ax * 6.36619772367581343076E-1 + 0x1.8p52;
+  VU qb = (VU)t;
+  V q = t - 0x1.8p52;
+  V z = ((ax - q * 1.57079625129699707031E0) - q * 7.54978941586159635335E-8) -
+        q * 5.39030285815811905290E-15;
+  V zz = z * z;
+  V s = S(spoly)(z, zz), c = S(cpoly)(zz);
+  VI odd = S(bit0)(qb), hi = S(bit0)(qb >> 1);
+  V r;
+  if (op == oSIN) {
+    r = S(sel)(odd, c, s);
+    r = S(sel)(hi, -r, r);
+    r = (V)((VU)r ^ ((VU)x & 0x8000000000000000ULL));
+  } else if (op == oCOS) {
+    r = S(sel)(odd, s, c);
+    r = S(sel)(odd ^ hi, -r, r);
+  } else {
+    r = S(sel)(odd, -c / s, s / c);
+    r = (V)((VU)r ^ ((VU)x & 0x8000000000000000ULL));
+  }
+  int big = kMASK(~(ax <= 1.073741824e9));
+  for (int j = 0; big; j++, big >>= 1) {
+    if (big & 1)
+      r[j] = op == oSIN ? sin(a[j]) : op == oCOS ? cos(a[j]) : tan(a[j]);
+  }
+  S(st)(a, r);
+}
+
+// q * b as hi + lo exactly, by dekker's splitting rather than fma. exact
+// while nothing overflows and the low parts stay above the subnormals
+kINL V S(split)(V x, V *lo) {
+  V c = x * 134217729.0;
+  V hi = c - (c - x);
+  *lo = x - hi;
+  return hi;
+}
+
+// fmod, bit for bit. the quotient is truncated while it is below 2^51, so
+// it is at most one off, a - q * b is exact from the two part product and
+// then moved by one b when q was one off. fmod takes the sign of a, zeros
+// included. lanes out of that range, zero or non-finite, go to libm
+kINL V S(fmod)(V a, V b) {
+  V t = a / b;
+  V q = S(sel)(t < 0.0, S(ceil)(t), S(floor)(t));
+  V ql, bl, qh = S(split)(q, &ql), bh = S(split)(b, &bl);
+  V p = q * b;
+  V pl = ((qh * bh - p) + qh * bl + ql * bh) + ql * bl;
+  V m = (a - p) - pl;
+  V ab = (V)((VU)S(fabs)(b) | ((VU)a & 0x8000000000000000ULL));
+  m = S(sel)(((a > 0.0) & (m < 0.0)) | ((a < 0.0) & (m > 0.0)), m + ab, m);
+  m = S(sel)(S(fabs)(m) >= S(fabs)(b), m - ab, m);
+  m = (V)((VU)S(fabs)(m) | ((VU)a & 0x8000000000000000ULL));
+  V ub = S(fabs)(b);
+  int slow = kMASK(~((S(fabs)(t) < 0x1p51) & (S(fabs)(a) < 0x1p1000) &
+                     (ub >= 0x1p-900) & (ub < 0x1p995)));
+  for (int j = 0; slow; j++, slow >>= 1) {
+    if (slow & 1)
+      m[j] = fmod(a[j], b[j]);
+  }
+  return m;
+}
+
+// log10 is left to libm too, ln(x) / ln(10) is not correctly rounded and
+// misses the integers at powers of ten, where floor(log(x)) steps
+
+// a ^ b stays with libm through the scalar path: exp(b * log(a)) from the
+// kernels above is only close, and b * log(a) scales that error up by as
+// much as the exponent of the result. constant integer powers are oPOWI
+kTARGET static int S(bin)(Op op, double *l, const double *r, int n,
+                          uint64_t *err) {
+  switch (op) {
+  case oADD:
+    for (int j = 0; j < n; j += kW)
+      S(st)(l + j, S(ld)(l + j) + S(ld)(r + j));
+    return 1;
+  case oSUB:
+    for (int j = 0; j < n; j += kW)
+      S(st)(l + j, S(ld)(l + j) - S(ld)(r + j));
+    return 1;
+  case oMUL:
+    for (int j = 0; j < n; j += kW)
+      S(st)(l + j, S(ld)(l + j) * S(ld)(r + j));
+    return 1;
+  case oDIV:
+    for (int j = 0; j < n; j += kW) {
+      V d = S(ld)(r + j);
+      *err |= (uint64_t)kMASK(S(fabs)(d) < 1e-15) << j;
+      S(st)(l + j, S(ld)(l + j) / d);
+    }
+    return 1;
+  case oMOD:
+    for (int j = 0; j < n; j += kW) {
+      V d = S(ld)(r + j);
+      *err |= (uint64_t)kMASK(S(fabs)(d) < 1e-15) << j;
+      S(st)(l + j, S(fmod)(S(ld)(l + j), d));
+    }
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+kTARGET static int S(un)(Op op, double *a, int n, double v) {
+  switch (op) {
+  case oNEG:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, -S(ld)(a + j));
+    return 1;
+  case oABS:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, S(fabs)(S(ld)(a + j)));
+    return 1;
+  case oFLOOR:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, S(floor)(S(ld)(a + j)));
+    return 1;
+  case oPOWI:
+    for (int j = 0; j < n; j += kW) {
+      V r = (V){0} + 1.0, b = S(ld)(a + j);
+      for (int k = (int)v; k; k >>= 1) {
+        if (k & 1)
+          r *= b;
+        b *= b;
+      }
+      S(st)(a + j, r);
+    }
+    return 1;
+  case oCEIL:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, S(ceil)(S(ld)(a + j)));
+    return 1;
+  case oSQRT:
+    for (int j = 0; j < n; j += kW) {
+      V x = S(ld)(a + j);
+      S(st)(a + j, S(sel)(x < 0.0, (V){0} + __builtin_nan(""), kSQRT(x)));
+    }
+    return 1;
+  case oEXP:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, S(exp)(S(ld)(a + j)));
+    return 1;
+  case oLN:
+    for (int j = 0; j < n; j += kW)
+      S(st)(a + j, S(log)(S(ld)(a + j)));
+    return 1;
+  case oSIN:
+  case oCOS:
+  case oTAN:
+    for (int j = 0; j < n; j += kW)
+      S(trig)(op, a + j);
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+#undef V
+#undef VI
+#undef VU
+#undef S
+#undef kINL
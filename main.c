@@ -7,12 +7,123 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
 #include "graph.h"
+#include "image.h"
 #include "maths.h"
 #include "parser.h"
+#include "pool.h"
+#include "render.h"
 #include "types.h"
+#include "vector.h"
+
+#define framePoll 10 // ms between looks at the render thread while it works
+
+// compares the native code against p_eval on random x, the values to a
+// relative 1e-9 and the NaNs exactly. returns the number of mismatches
+static int jit_check(int n, char **formulas) {
+  static const char *dflt[] = {
+      "sin(x)",        "x^3 - 2*x + 1",  "1/x",        "sqrt(x) + ln(x)",
+      "tan(x)*cos(x)", "exp(-x^2)",      "x%3",        "floor(x) - ceil(x)",
+      "abs(x)^0.5",    "(x/2)!",         "asin(x/10)", "tanh(x)/cosh(x)",
+      "x^x",           "2^(-x)",         "log(abs(x))", "sqrt(x)",
+      "1/(x*1e-14)",   "floor(log(abs(x)*1e14))"};
+  if (n == 0) {
+    n = sizeof(dflt) / sizeof(dflt[0]);
+    formulas = (char **)dflt;
+  }
+
+  // the native code against the interpreter on the same samples, bit for
+  // bit, NaN signs and all
+  enum { samples = 4096 };
+  static double xs[samples], ys[samples], want[samples];
+  int bad = 0, native = 0;
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    Prog *pg = p_compile(formulas[i]), *ref = p_compile(formulas[i]);
+    if (!pg || !ref || pg->root < 0) {
+      printf("%-24s  does not compile\n", formulas[i]);
+      bad++;
+      p_free(pg);
+      p_free(ref);
+      continue;
+    }
+    int ok = p_jit(pg) == 0;
+    native += ok;
+    for (int j = 0; j < samples; j++)
+      xs[j] = (rand() / (double)RAND_MAX - 0.5) * 40;
+    xs[0] = 0;
+    xs[1] = 1e-300;
+    xs[2] = -5e-324;
+    xs[3] = 1e-15;
+    p_batch(pg, xs, ys, samples);
+    p_batch(ref, xs, want, samples);
+    int miss = 0;
+    for (int j = 0; j < samples; j++) {
+      if (memcmp(&ys[j], &want[j], sizeof(double))) {
+        if (!miss)
+          printf("%-24s  x = %.17g: %.17g, want %.17g\n", formulas[i], xs[j],
+                 ys[j], want[j]);
+        miss++;
+      }
+    }
+    printf("%-24s  %s  %d/%d %s\n", formulas[i], ok ? "jit " : "interp",
+           samples - miss, samples, miss ? "FAIL" : "ok");
+    bad += miss != 0;
+    p_free(pg);
+    p_free(ref);
+  }
+  printf("%d formulas, %d native, %d failed\n", n, native, bad);
+  return bad;
+}
+
+int main(int argc, char **argv) {
+  int threads = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--no-jit") == 0) {
+      p_jit_enable(0);
+    } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      f_cache_budget((size_t)(atof(argv[++i]) * (1 << 20)));
+    } else if (strcmp(argv[i], "--png-level") == 0 && i + 1 < argc &&
+               argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9' &&
+               !argv[i + 1][1]) {
+      d_png_level(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc &&
+               d_vector_tolerance(atof(argv[i + 1])) == 0) {
+      i++;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--jit-check") == 0) {
+      return jit_check(argc - i - 1, argv + i + 1) ? 1 : 0;
+    } else if (strcmp(argv[i], "--render") == 0 ||
+               strcmp(argv[i], "--manifest") == 0) {
+      t_start(threads);
+      int r = b_run(argc - i, argv + i);
+      t_stop();
+      f_cache_clear();
+      return r;
+    } else if (strcmp(argv[i], "--eval") == 0) {
+      t_start(threads);
+      int r = b_eval(argc - i, argv + i);
+      t_stop();
+      return r;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--no-jit] [--cache MB] [--threads N] "
+              "[--png-level 0-9] [--tolerance PX] "
+              "[--jit-check [formula...]]\n"
+              "       %s [options] --render FILE [--size WxH] [--x A:B] "
+              "[--y C:D] -f FORMULA...\n"
+              "       %s [options] --manifest FILE\n"
+              "       %s [options] --eval FORMULA [--x A:B] [--n N] "
+              "[--format csv|bin] [--out FILE]\n",
+              argv[0], argv[0], argv[0], argv[0]);
+      return 2;
+    }
+  }
+  // 0 is one thread per cpu
+  t_start(threads);
 
-int main(void) {
   initscr();
   cbreak();
   noecho();
@@ -55,19 +166,55 @@ int main(void) {
   IntegrationState integ = {0};
 
   PView view = {
-      .mX = -10.0, .mmX = 10.0, .mY = -10.0, .mmY = 10.0, .autoScale = 1};
+      .mX = -10.0,
+      .mmX = 10.0,
+      .mY = -10.0,
+      .mmY = 10.0,
+      .autoScale = 1,
+      .envelope = 1};
   PView default_view = view;
+  PFrame frame = {0}, side = {0}, img = {0};
+  PScene shown = {0};
 
   autoscale(&view, &funcs);
-  d_sidebar(sidebar, &funcs, &view, mode, cmd_input, show_derivative, trace_x,
-            trace_slope, &integ);
-  d_plot(plotwin, &funcs, &view, 0, trace_x, show_derivative, trace_slope,
-         &integ);
+  r_start();
 
-  int ch, running = 1;
+  // keys already queued are all handled before anything is drawn, so a
+  // held key doesn't pile up frames. the plot is drawn by the render
+  // thread, and the loop waits on input and on it in turns
+  int ch, running = 1, redraw = 1, replot = 1;
+  timeout(0);
   while (running) {
     ch = getch();
-    int redraw = 0, replot = 0;
+    if (ch == ERR) {
+      if (redraw)
+        d_sidebar(sidebar, &side, &funcs, &view, mode, cmd_input,
+                  show_derivative, trace_x, trace_slope, &integ);
+      if (replot) {
+        PScene sc = {.funcs = funcs, .v = view, .integ = integ};
+        getmaxyx(plotwin, sc.h, sc.w);
+        sc.w -= 4;
+        sc.h -= 4;
+        sc.trace_mode = mode == mTRACE;
+        sc.show_deriv = show_derivative;
+        sc.trace_X = trace_x;
+        sc.trace_slope = trace_slope;
+        r_post(&sc);
+      }
+      redraw = replot = 0;
+      if (mode != mHELP && r_take(&img, &shown)) {
+        for (int i = 0; i < funcs.count && i < shown.funcs.count; i++)
+          if (strcmp(funcs.functions[i].formula,
+                     shown.funcs.functions[i].formula) == 0)
+            funcs.functions[i].evals = shown.funcs.functions[i].evals;
+        d_plot(plotwin, &frame, &img, &shown);
+        d_sidebar(sidebar, &side, &funcs, &view, mode, cmd_input,
+                  show_derivative, trace_x, trace_slope, &integ);
+      }
+      timeout(mode != mHELP && r_pending() ? framePoll : -1);
+      continue;
+    }
+    timeout(0);
 
     if (mode == mHELP) {
       mode = mNORMAL;
@@ -136,8 +283,7 @@ int main(void) {
       if (trace_x > view.mmX)
         trace_x = view.mmX;
       if (show_derivative && funcs.count > 0) {
-        trace_slope =
-            num_deriv(funcs.functions[funcs.sel].formula, trace_x, 0.0001);
+        trace_slope = deriv(&funcs.functions[funcs.sel], trace_x);
       }
     } else if (mode == mINTEGRATE) {
       double step = (view.mmX - view.mX) / 50.0;
@@ -170,7 +316,7 @@ int main(void) {
           integ.b = integ.a + 1;
         } else {
           if (funcs.count > 0) {
-            integ.result = simpsons_rule(funcs.functions[funcs.sel].formula,
+            integ.result = simpsons_rule(f_prog(&funcs.functions[funcs.sel]),
                                          integ.a, integ.b, 100);
           }
           mode = mNORMAL;
@@ -185,12 +331,18 @@ int main(void) {
         int m_count = g_cmd_matches(cmd_input, m, cmdCount);
         if (m_count > 0) {
           const char *comp = m[0]->c;
-          strncpy(cmd_input, comp, mmFormulaLen - 1);
+          int w = g_cmd_word(cmd_input);
+          strncpy(cmd_input + w, comp, mmFormulaLen - 1 - w);
           cmd_input[mmFormulaLen - 1] = '\0';
           cmd_pos = strlen(cmd_input);
-          if (strcmp(comp, "add") == 0 || strcmp(comp, "remove") == 0 ||
-              strcmp(comp, "select") == 0 || strcmp(comp, "w") == 0 ||
-              strcmp(comp, "wi") == 0) {
+          const Builtin *bi = w ? p_lookup(comp, strlen(comp)) : NULL;
+          if (bi && bi->arity && cmd_pos < mmFormulaLen - 1) {
+            cmd_input[cmd_pos++] = '(';
+            cmd_input[cmd_pos] = '\0';
+          } else if (strcmp(comp, "add") == 0 || strcmp(comp, "deriv") == 0 ||
+                     strcmp(comp, "remove") == 0 ||
+                     strcmp(comp, "select") == 0 || strcmp(comp, "w") == 0 ||
+                     strcmp(comp, "wi") == 0 || strcmp(comp, "ws") == 0) {
             if (cmd_pos < mmFormulaLen - 1) {
               cmd_input[cmd_pos++] = ' ';
               cmd_input[cmd_pos] = '\0';
@@ -207,6 +359,7 @@ int main(void) {
         } else if (strcmp(cmd_input, "help") == 0) {
           mode = mHELP;
           d_help(plotwin);
+          frame.valid = 0;
         } else if (strcmp(cmd_input, "integrate") == 0) {
           mode = mINTEGRATE;
           integ.active = 1;
@@ -219,6 +372,20 @@ int main(void) {
           if (view.autoScale)
             autoscale(&view, &funcs);
           replot = 1;
+        } else if (strcmp(cmd_input, "deriv") == 0 ||
+                   strncmp(cmd_input, "deriv ", 6) == 0) {
+          int idx = cmd_input[5] ? atoi(cmd_input + 6) - 1 : funcs.sel;
+          if (idx >= 0 && idx < funcs.count) {
+            char d[mmFormulaLen];
+            const Prog *dp = f_dprog(&funcs.functions[idx]);
+            if (dp && dp->root >= 0 &&
+                p_format(dp, d, sizeof(d)) < mmFormulaLen) {
+              f_add(&funcs, d);
+              if (view.autoScale)
+                autoscale(&view, &funcs);
+              replot = 1;
+            }
+          }
         } else if (strncmp(cmd_input, "remove ", 7) == 0) {
           int idx = atoi(cmd_input + 7) - 1;
           f_rem(&funcs, idx);
@@ -229,32 +396,38 @@ int main(void) {
           int idx = atoi(cmd_input + 7) - 1;
           if (idx >= 0 && idx < funcs.count)
             funcs.sel = idx;
-        } else if (strncmp(cmd_input, "wi ", 3) == 0) {
-          int h, w;
-          getmaxyx(plotwin, h, w);
-          char **buf = malloc(h * sizeof(char *));
-          for (int i = 0; i < h; i++) {
-            buf[i] = malloc(w);
-            for (int j = 0; j < w; j++)
-              buf[i][j] = mvwinch(plotwin, i, j) & A_CHARTEXT;
+        } else if (strncmp(cmd_input, "view ", 5) == 0) {
+          PView nv = view;
+          if (sscanf(cmd_input + 5, "%lf %lf %lf %lf", &nv.mX, &nv.mmX,
+                     &nv.mY, &nv.mmY) == 4 &&
+              nv.mX < nv.mmX && nv.mY < nv.mmY) {
+            nv.autoScale = 0;
+            view = nv;
+            replot = 1;
           }
-          export_png(cmd_input + 3, buf, h, w);
-          for (int i = 0; i < h; i++)
-            free(buf[i]);
-          free(buf);
-        } else if (strncmp(cmd_input, "w ", 2) == 0) {
-          int h, w;
-          getmaxyx(plotwin, h, w);
-          char **buf = malloc(h * sizeof(char *));
-          for (int i = 0; i < h; i++) {
-            buf[i] = malloc(w);
-            for (int j = 0; j < w; j++)
-              buf[i][j] = mvwinch(plotwin, i, j) & A_CHARTEXT;
+        } else if (strncmp(cmd_input, "wi ", 3) == 0 ||
+                   strncmp(cmd_input, "ws ", 3) == 0) {
+          // wi/ws FILE [WxH], by default 6 x 12 units per cell of the plot
+          char *name = cmd_input + 3, *sp = strrchr(name, ' '), end;
+          int w = frame.w * 6, h = frame.h * 12, sw, sh;
+          if (sp && sscanf(sp + 1, "%dx%d%c", &sw, &sh, &end) == 2 &&
+              sw > 0 && sh > 0) {
+            *sp = '\0';
+            w = sw;
+            h = sh;
           }
-          export_text(cmd_input + 2, buf, h, w);
-          for (int i = 0; i < h; i++)
-            free(buf[i]);
-          free(buf);
+          for (int i = 0; i < funcs.count; i++)
+            f_prog(&funcs.functions[i]);
+          PScene sc = {.funcs = funcs, .v = view, .integ = integ};
+          const char *dot = strrchr(name, '.');
+          if (cmd_input[1] == 'i')
+            export_png(name, &sc, w, h);
+          else if (dot && strcmp(dot, ".pdf") == 0)
+            export_pdf(name, &sc, w, h);
+          else
+            export_svg(name, &sc, w, h);
+        } else if (strncmp(cmd_input, "w ", 2) == 0) {
+          export_text(cmd_input + 2, &frame);
         }
         cmd_input[0] = '\0';
         cmd_pos = 0;
@@ -309,14 +482,17 @@ int main(void) {
       case KEY_BACKSPACE:
       case 127:
       case '\b':
-        if (len > 0)
+        if (len > 0) {
           formula[len - 1] = '\0';
+          f_invalidate(&funcs.functions[funcs.sel]);
+        }
         redraw = 1;
         break;
       default:
         if (isprint(ch) && len < mmFormulaLen - 1) {
           formula[len] = ch;
           formula[len + 1] = '\0';
+          f_invalidate(&funcs.functions[funcs.sel]);
           redraw = 1;
         }
         break;
@@ -333,7 +509,7 @@ int main(void) {
         mode = mTRACE;
         trace_x = (view.mX + view.mmX) / 2.0;
         if (funcs.count > 0) {
-          find_crit_points(funcs.functions[funcs.sel].formula, &view,
+          find_crit_points(f_prog(&funcs.functions[funcs.sel]), &view,
                            critical_points, &critical_point_count);
         }
         redraw = replot = 1;
@@ -362,6 +538,27 @@ int main(void) {
           redraw = replot = 1;
         }
         break;
+      case KEY_LEFT:
+      case KEY_RIGHT:
+      case 'H':
+      case 'L': {
+        // an eighth of the plot at a time
+        int w = getmaxx(plotwin) - 4, h = getmaxy(plotwin) - 4;
+        int step = w / 8 > 1 ? w / 8 : 1;
+        pan(&view, ch == KEY_LEFT || ch == 'H' ? -step : step, 0, w, h);
+        redraw = replot = 1;
+        break;
+      }
+      case KEY_SF:
+      case KEY_SR:
+      case 'J':
+      case 'K': {
+        int w = getmaxx(plotwin) - 4, h = getmaxy(plotwin) - 4;
+        int step = h / 8 > 1 ? h / 8 : 1;
+        pan(&view, 0, ch == KEY_SF || ch == 'J' ? -step : step, w, h);
+        redraw = replot = 1;
+        break;
+      }
       case '+':
       case '=':
         zoom(&view, 0.8);
@@ -373,12 +570,15 @@ int main(void) {
         redraw = replot = 1;
         break;
       case 'r':
-      case 'R':
+      case 'R': {
+        int envelope = view.envelope;
         view = default_view;
         view.autoScale = 1;
+        view.envelope = envelope;
         autoscale(&view, &funcs);
         redraw = replot = 1;
         break;
+      }
       case 'a':
       case 'A':
         view.autoScale = !view.autoScale;
@@ -386,17 +586,23 @@ int main(void) {
           autoscale(&view, &funcs);
         redraw = replot = 1;
         break;
+      case 'e':
+      case 'E':
+        view.envelope = !view.envelope;
+        replot = 1;
+        break;
       }
     }
-
-    if (redraw)
-      d_sidebar(sidebar, &funcs, &view, mode, cmd_input, show_derivative,
-                trace_x, trace_slope, &integ);
-    if (replot)
-      d_plot(plotwin, &funcs, &view, mode == mTRACE, trace_x, show_derivative,
-             trace_slope, &integ);
   }
 
+  r_stop();
+  for (int i = 0; i < funcs.count; i++)
+    f_invalidate(&funcs.functions[i]);
+  d_frame_free(&frame);
+  d_frame_free(&img);
+  d_frame_free(&side);
+  f_cache_clear();
+  t_stop();
   delwin(sidebar);
   delwin(plotwin);
   endwin();
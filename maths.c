@@ -7,28 +7,70 @@
 
 #include "maths.h"
 #include "parser.h"
+#include "pool.h"
 #include "types.h"
 
-double num_deriv(const char *f, double x, double h) {
-  double f_plus = p_eval(f, x + h);
-  double f_minus = p_eval(f, x - h);
-  if (isnan(f_plus) || isnan(f_minus))
-    return NAN;
-  return (f_plus - f_minus) / (2.0 * h);
+#define sampleGrid 4    // columns between the first samples
+#define sampleDepth 10  // most halvings of a segment
+#define simpChunk 1024  // inner samples per task of simpsons_rule
+#define scanSamples 500 // samples per function of autoscale
+
+// slope by forward differentiation, NaN wherever f itself is undefined
+double deriv(F *fn, double x) {
+  Dual r = p_dual(f_prog(fn), x);
+  return isnan(r.v) ? NAN : r.d;
 }
 
-double simpsons_rule(const char *f, double a, double b, int n) {
+typedef struct {
+  const Prog *f;
+  double a, h;
+  int n;
+  double *sums; // one per chunk, the first starts from the two ends
+} Simp;
+
+// the weighted inner samples of chunk c, the simpChunk from 1 + c*simpChunk
+static void simp_chunk(void *arg, int c) {
+  Simp *s = arg;
+  int lo = 1 + c * simpChunk, m = s->n - lo < simpChunk ? s->n - lo : simpChunk;
+  double *xs = calloc(m, sizeof(double)), *ys = malloc(m * sizeof(double));
+  if (!xs || !ys) {
+    free(xs);
+    free(ys);
+    s->sums[c] = NAN;
+    return;
+  }
+  for (int i = 0; i < m; i++)
+    xs[i] = s->a + (lo + i) * s->h;
+  p_batch(s->f, xs, ys, m);
+  double t = s->sums[c];
+  for (int i = 0; i < m; i++) {
+    if (!isnan(ys[i]))
+      t += ((lo + i) % 2 == 0 ? 2 : 4) * ys[i];
+  }
+  s->sums[c] = t;
+  free(xs);
+  free(ys);
+}
+
+// the chunks go to the pool and are added up in order, so the sum is the
+// same for any number of threads
+double simpsons_rule(const Prog *f, double a, double b, int n) {
   if (n % 2 != 0)
     n++;
-  double h = (b - a) / n;
-  double s = p_eval(f, a) + p_eval(f, b);
-  for (int i = 1; i < n; i++) {
-    double x_val = a + i * h;
-    double val = p_eval(f, x_val);
-    if (!isnan(val))
-      s += (i % 2 == 0 ? 2 : 4) * val;
-  }
-  return (h / 3.0) * s;
+  int chunks = (n - 2) / simpChunk + 1;
+  double *sums = calloc(chunks, sizeof(double));
+  if (!sums)
+    return NAN;
+  double xs[2] = {a, b}, ys[2];
+  p_batch(f, xs, ys, 2);
+  sums[0] = ys[0] + ys[1];
+  Simp s = {f, a, (b - a) / n, n, sums};
+  t_for(chunks, simp_chunk, &s);
+  double t = 0;
+  for (int c = 0; c < chunks; c++)
+    t += sums[c];
+  free(sums);
+  return (s.h / 3.0) * t;
 }
 
 void f_add(FLists *funcs, const char *f) {
@@ -38,6 +80,8 @@ void f_add(FLists *funcs, const char *f) {
   funcs->functions[funcs->count].formula[mmFormulaLen - 1] = '\0';
   funcs->functions[funcs->count].col = (funcs->count % 6) + 1;
   funcs->functions[funcs->count].active = 1;
+  funcs->functions[funcs->count].prog = NULL;
+  funcs->functions[funcs->count].dprog = NULL;
   funcs->sel = funcs->count;
   funcs->count++;
 }
@@ -45,6 +89,7 @@ void f_add(FLists *funcs, const char *f) {
 void f_rem(FLists *funcs, int index) {
   if (index < 0 || index >= funcs->count || funcs->count <= 1)
     return;
+  f_invalidate(&funcs->functions[index]);
   for (int i = index; i < funcs->count - 1; i++) {
     funcs->functions[i] = funcs->functions[i + 1];
   }
@@ -53,42 +98,193 @@ void f_rem(FLists *funcs, int index) {
     funcs->sel = funcs->count - 1;
 }
 
-void find_crit_points(const char *f, PView *v, double *points, int *count) {
+const Prog *f_prog(F *fn) {
+  if (!fn->prog) {
+    fn->prog = p_compile(fn->formula);
+    p_jit(fn->prog);
+  }
+  return fn->prog;
+}
+
+const Prog *f_dprog(F *fn) {
+  if (!fn->dprog) {
+    fn->dprog = p_deriv(f_prog(fn));
+    p_jit(fn->dprog);
+  }
+  return fn->dprog;
+}
+void f_invalidate(F *fn) {
+  p_free(fn->prog);
+  p_free(fn->dprog);
+  fn->prog = fn->dprog = NULL;
+}
+
+// newton on f (d = 0) or f' (d = 1) from x0, using the dual numbers for the
+// slope. gives up and returns x0 if it leaves [lo, hi]
+static double refine(const Prog *f, int d, double lo, double hi, double x0) {
+  double x = x0;
+  for (int k = 0; k < 8; k++) {
+    Dual r = p_dual(f, x);
+    double g = d ? r.d : r.v, g1 = d ? r.dd : r.d;
+    if (isnan(g) || isnan(g1) || g1 == 0)
+      return x0;
+    double nx = x - g / g1;
+    if (!(nx >= lo && nx <= hi))
+      return x0;
+    if (fabs(nx - x) <= 1e-12 * fmax(1, fabs(x)))
+      return nx;
+    x = nx;
+  }
+  return x;
+}
+
+// roots are sign changes of f, extrema sign changes of f', both refined.
+// samples that land exactly on a zero count as they are
+void find_crit_points(const Prog *f, PView *v, double *points, int *count) {
   *count = 0;
   int samples = 500;
-  double prev_Y = p_eval(f, v->mX);
-  double prev_X = v->mX;
-  double prev_slope = 0;
+  double xs[500];
+  Dual ys[500];
+  for (int i = 0; i < samples; i++)
+    xs[i] = v->mX + (v->mmX - v->mX) * i / samples;
+  p_dual_batch(f, xs, ys, samples);
   for (int i = 1; i < samples && *count < 20; i++) {
-    double x = v->mX + (v->mmX - v->mX) * i / samples;
-    double y = p_eval(f, x);
-    if (isnan(y) || isnan(prev_Y)) {
-      prev_Y = y;
-      prev_X = x;
+    Dual a = ys[i - 1], b = ys[i];
+    if (isnan(a.v) || isnan(b.v))
       continue;
+    if (b.v == 0 && a.v != 0) {
+      points[(*count)++] = xs[i];
+    } else if ((a.v < 0 && b.v > 0) || (a.v > 0 && b.v < 0)) {
+      double x0 = fabs(b.v) < fabs(a.v) ? xs[i] : xs[i - 1];
+      points[(*count)++] = refine(f, 0, xs[i - 1], xs[i], x0);
+    } else if (b.d == 0 && a.d != 0) {
+      points[(*count)++] = xs[i];
+    } else if ((a.d < 0 && b.d > 0) || (a.d > 0 && b.d < 0)) {
+      double x0 = fabs(b.d) < fabs(a.d) ? xs[i] : xs[i - 1];
+      points[(*count)++] = refine(f, 1, xs[i - 1], xs[i], x0);
     }
-    double dX = x - prev_X;
-    double slope = (y - prev_Y) / dX;
-    if ((prev_Y < 0 && y > 0) || (prev_Y > 0 && y < 0)) {
-      points[(*count)++] = fabs(y) < fabs(prev_Y) ? x : prev_X;
-    } else if (i > 1 && (prev_slope < 0 && slope > 0) ||
-               (prev_slope > 0 && slope < 0)) {
-      points[(*count)++] = prev_X;
+  }
+}
+
+// screen row of y, fractional
+static double row(const PView *v, int h, double y) {
+  return (y - v->mY) / (v->mmY - v->mY) * h;
+}
+
+// an adaptive set of samples of f across the view, for a plot w columns by
+// h rows. starts from a grid of powers of two apart, 2 to sampleGrid
+// columns, that reaches just past both edges, and splits
+// a segment again while its midpoint strays more than half a row from the
+// chord (on screen) or only some of its three points are defined. stops after
+// sampleDepth halvings or once budget evaluations are used, and a segment
+// still failing then with a jump of over two rows is taken for a
+// discontinuity (brk) instead of being joined. returns the number of
+// points in *out (the caller frees it). budget counts samples, the ones
+// the cache (f_samples) did not have and were evaluated go to *evals.
+// being dyadic the samples come out the same at any view, so the cache
+// serves whatever was seen before
+int sample_curve(const Prog *f, const PView *v, int w, int h, int budget,
+                 SPoint **out, int *evals) {
+  double g = (v->mmX - v->mX) / w * sampleGrid;
+  double step = g > 0 && isfinite(g) ? ldexp(1, ilogb(g)) : 0;
+  double k0 = step ? floor(v->mX / step) : 0;
+  double k1 = step ? ceil(v->mmX / step) : 0;
+  int n = step && k1 - k0 < 4.0 * w + 8 ? (int)(k1 - k0) + 1 : 0;
+  if (budget < n)
+    budget = n;
+  // every sample adds one point, so n + budget bounds them all
+  int cap = n + budget;
+  SPoint *p = malloc(cap * sizeof(SPoint)), *np = malloc(cap * sizeof(SPoint));
+  char *act = malloc(cap), *nact = malloc(cap);
+  double *xs = calloc(cap, sizeof(double)), *ys = malloc(cap * sizeof(double));
+  *evals = 0;
+  if (!p || !np || !act || !nact || !xs || !ys) {
+    free(p);
+    n = 0;
+    p = NULL;
+  }
+
+  for (int i = 0; i < n; i++)
+    xs[i] = (k0 + i) * step;
+  *evals = f_samples(f, xs, ys, n);
+  int used = n;
+  for (int i = 0; i < n; i++) {
+    p[i] = (SPoint){xs[i], ys[i], 0};
+    act[i] = i < n - 1;
+  }
+
+  for (int depth = 0; n; depth++) {
+    int k = 0;
+    for (int i = 0; i < n - 1; i++)
+      k += act[i];
+    if (k == 0)
+      break;
+    if (used + k > budget) {
+      // out of budget, what is still open is judged on its ends alone
+      for (int i = 0; i < n - 1; i++)
+        if (act[i] && fabs(row(v, h, p[i + 1].y) - row(v, h, p[i].y)) > 2)
+          p[i].brk = 1;
+      break;
     }
-    prev_slope = slope;
-    prev_Y = y;
-    prev_X = x;
+
+    for (int i = 0, j = 0; i < n - 1; i++)
+      if (act[i])
+        xs[j++] = (p[i].x + p[i + 1].x) / 2;
+    *evals += f_samples(f, xs, ys, k);
+    used += k;
+
+    int last = depth + 1 >= sampleDepth, m = 0;
+    for (int i = 0, j = 0; i < n; i++) {
+      np[m] = p[i];
+      nact[m++] = 0;
+      if (i == n - 1 || !act[i])
+        continue;
+      SPoint a = p[i], b = p[i + 1], c = {xs[j], ys[j], 0};
+      j++;
+      int fa = isfinite(a.y), fb = isfinite(b.y), fc = isfinite(c.y);
+      double ra = row(v, h, a.y), rb = row(v, h, b.y), rc = row(v, h, c.y);
+      // all three past the same edge is left alone, off screen shape
+      // doesn't matter
+      int off = (ra < 0 && rb < 0 && rc < 0) || (ra > h && rb > h && rc > h);
+      int split = fa != fb || fa != fc ||
+                  (fa && !off && fabs(rc - (ra + rb) / 2) > 0.5);
+      if (split && last) {
+        np[m - 1].brk = fabs(rc - ra) > 2;
+        c.brk = fabs(rb - rc) > 2;
+      }
+      nact[m - 1] = split && !last;
+      np[m] = c;
+      nact[m++] = split && !last;
+    }
+    SPoint *tp = p;
+    p = np;
+    np = tp;
+    char *ta = act;
+    act = nact;
+    nact = ta;
+    n = m;
   }
+
+  free(np);
+  free(act);
+  free(nact);
+  free(xs);
+  free(ys);
+  *out = p;
+  return n;
 }
 
-void find_intersections(const char *f1, const char *f2, PView *v,
+void find_intersections(const Prog *f1, const Prog *f2, PView *v,
                         double *points, int *count) {
   *count = 0;
   int samples = 500;
-  double prev_diff = p_eval(f1, v->mX) - p_eval(f2, v->mX);
+  double y1[500], y2[500];
+  p_lin(f1, v->mX, v->mmX, samples, y1);
+  p_lin(f2, v->mX, v->mmX, samples, y2);
+  double prev_diff = y1[0] - y2[0];
   for (int i = 1; i < samples && *count < 20; i++) {
     double x = v->mX + (v->mmX - v->mX) * i / samples;
-    double diff = p_eval(f1, x) - p_eval(f2, x);
+    double diff = y1[i] - y2[i];
     if (!isnan(diff) && !isnan(prev_diff)) {
       if ((prev_diff < 0 && diff > 0) || (prev_diff > 0 && diff < 0)) {
         double prev_X = v->mX + (v->mmX - v->mX) * (i - 1) / samples;
@@ -100,15 +296,34 @@ void find_intersections(const char *f1, const char *f2, PView *v,
   }
 }
 
+typedef struct {
+  const Prog *progs[mmFuncs]; // NULL for inactive functions
+  const PView *v;
+  double ys[mmFuncs][scanSamples];
+} Scan;
+
+static void scan_one(void *arg, int f) {
+  Scan *s = arg;
+  if (s->progs[f])
+    p_lin(s->progs[f], s->v->mX, s->v->mmX, scanSamples, s->ys[f]);
+}
+
 void autoscale(PView *v, FLists *funcs) {
   double mY = INFINITY, mmY = -INFINITY;
-  int samples = 500, valid_points = 0;
+  int valid_points = 0;
+  Scan *s = malloc(sizeof(Scan));
+  if (!s)
+    return;
+  s->v = v;
+  for (int f = 0; f < funcs->count; f++)
+    s->progs[f] =
+        funcs->functions[f].active ? f_prog(&funcs->functions[f]) : NULL;
+  t_for(funcs->count, scan_one, s);
   for (int f = 0; f < funcs->count; f++) {
-    if (!funcs->functions[f].active)
+    if (!s->progs[f])
       continue;
-    for (int i = 0; i < samples; i++) {
-      double x = v->mX + (v->mmX - v->mX) * i / samples;
-      double y = p_eval(funcs->functions[f].formula, x);
+    for (int i = 0; i < scanSamples; i++) {
+      double y = s->ys[f][i];
       if (!isnan(y) && !isinf(y) && fabs(y) < 1e6) {
         if (y < mY)
           mY = y;
@@ -118,6 +333,7 @@ void autoscale(PView *v, FLists *funcs) {
       }
     }
   }
+  free(s);
   if (valid_points > 10 && isfinite(mY) && isfinite(mmY) && mmY > mY) {
     double range = mmY - mY;
     double margin = range * 0.15;
@@ -142,3 +358,15 @@ void zoom(PView *v, double factor) {
   v->mmY = center_Y + range_Y;
   v->autoScale = 0;
 }
+
+// moves the view of a w x h plot by whole columns and rows, so the columns
+// already drawn line up with the new ones
+void pan(PView *v, int cols, int rows, int w, int h) {
+  double dx = (v->mmX - v->mX) / w * cols;
+  double dy = (v->mmY - v->mY) / h * rows;
+  v->mX += dx;
+  v->mmX += dx;
+  v->mY += dy;
+  v->mmY += dy;
+  v->autoScale = 0;
+}
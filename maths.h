@@ -8,20 +8,34 @@
 // f formula(s)
 
 // calculus
-double num_deriv(const char *f, double x, double h);
-double simpsons_rule(const char *f, double a, double b, int n);
+double deriv(F *fn, double x);
+double simpsons_rule(const Prog *f, double a, double b, int n);
 
 // funcs
 void f_add(FLists *funcs, const char *f);
 void f_rem(FLists *funcs, int index);
+const Prog *f_prog(F *fn);
+const Prog *f_dprog(F *fn);
+void f_invalidate(F *fn);
 
 // analysis
-void find_crit_points(const char *f, PView *v, double *points, int *count);
-void find_intersections(const char *f1, const char *f2, PView *v,
+void find_crit_points(const Prog *f, PView *v, double *points, int *count);
+void find_intersections(const Prog *f1, const Prog *f2, PView *v,
                         double *points, int *count);
 
+// plotting
+int sample_curve(const Prog *f, const PView *v, int w, int h, int budget,
+                 SPoint **out, int *evals);
+
+// sample cache
+int f_samples(const Prog *f, const double *xs, double *ys, int n);
+void f_cache_budget(size_t bytes);
+void f_cache_stats(long *hits, long *misses, size_t *bytes);
+void f_cache_clear(void);
+
 // view
 void autoscale(PView *v, FLists *funcs);
 void zoom(PView *v, double factor);
+void pan(PView *v, int cols, int rows, int w, int h);
 
 #endif // !MATHS_H
@@ -8,13 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-static double parse_expr(const char **p, double x, int *e);
-static double parse_term(const char **p, double x, int *e);
-static double parse_factor(const char **p, double x, int *e);
-static double parse_power(const char **p, double x, int *e);
-static double parse_unary(const char **p, double x, int *e);
+static int parse_expr(const char **p, Prog *pg);
+static int parse_term(const char **p, Prog *pg);
+static int parse_factor(const char **p, Prog *pg);
+static int parse_power(const char **p, Prog *pg);
+static int parse_unary(const char **p, Prog *pg);
 static void swsp(const char **p);
-static double factorial(double n);
 
 static void swsp(const char **p) {
   while (isspace(**p)) {
@@ -22,157 +21,56 @@ static void swsp(const char **p) {
   }
 }
 
-static double factorial(double n) {
-  if (n < 0 || n != floor(n))
-    return NAN;
-  if (n > 170)
-    return INFINITY;
-  if (n == 0 || n == 1)
-    return 1.0;
-  double result = 1.0;
-  for (int i = 2; i <= (int)n; i++)
-    result *= i;
-  return result;
-}
-
-static int cstrncasecmp(const char *s1, const char *s2, size_t n) {
-  for (size_t i = 0; i < n; i++) {
-    int c1 = tolower((unsigned char)s1[i]);
-    int c2 = tolower((unsigned char)s2[i]);
-    if (c1 != c2)
-      return c1 - c2;
-    if (c1 == '\0')
-      return 0;
+int p_node(Prog *pg, Op op, int a, int b, double v) {
+  if (pg->n_nodes == pg->cap) {
+    int cap = pg->cap ? pg->cap * 2 : 32;
+    CNode *n = realloc(pg->nodes, cap * sizeof(CNode));
+    if (!n)
+      return -1;
+    pg->nodes = n;
+    pg->cap = cap;
   }
-  return 0;
+  pg->nodes[pg->n_nodes] = (CNode){op, a, b, v};
+  return pg->n_nodes++;
 }
 
-static double parse_atom(const char **p, double x, int *e) {
+static int parse_atom(const char **p, Prog *pg) {
   swsp(p);
 
   if (**p == '(') {
     (*p)++;
-    double val = parse_expr(p, x, e);
-    if (*e)
-      return NAN;
+    int val = parse_expr(p, pg);
+    if (val < 0)
+      return -1;
     swsp(p);
     if (**p == ')') {
       (*p)++;
     } else {
-      *e = 1;
-      return NAN;
+      return -1;
     }
     return val;
   }
 
   if (**p == 'x' || **p == 'X') {
     (*p)++;
-    return x;
-  }
-
-  if (cstrncasecmp(*p, "pi", 2) == 0) {
-    if (!isalpha(*(*p + 2))) {
-      *p += 2;
-      return M_PI;
-    }
+    return p_node(pg, oX, -1, -1, 0);
   }
 
-  if ((**p == 'e' || **p == 'E')) {
-    char next = *(*p + 1);
-    if (!isalpha(next)) {
-      (*p)++;
-      return M_E;
-    }
-  }
-
-  if (cstrncasecmp(*p, "asin", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    double arg = parse_unary(p, x, e);
-    if (*e)
-      return NAN;
-    if (arg < -1.0 || arg > 1.0)
-      return NAN;
-    return asin(arg);
-  }
-  if (cstrncasecmp(*p, "acos", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    double arg = parse_unary(p, x, e);
-    if (*e)
-      return NAN;
-    if (arg < -1.0 || arg > 1.0)
-      return NAN;
-    return acos(arg);
-  }
-  if (cstrncasecmp(*p, "atan", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    return atan(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "sinh", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    return sinh(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "cosh", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    return cosh(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "tanh", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    return tanh(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "sin", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    return sin(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "cos", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    return cos(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "tan", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    return tan(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "exp", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    return exp(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "sqrt", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    double arg = parse_unary(p, x, e);
-    if (*e)
-      return NAN;
-    if (arg < 0.0)
-      return NAN;
-    return sqrt(arg);
-  }
-  if (cstrncasecmp(*p, "ln", 2) == 0 && !isalpha(*(*p + 2))) {
-    *p += 2;
-    double arg = parse_unary(p, x, e);
-    if (*e)
-      return NAN;
-    if (arg <= 0.0)
-      return NAN;
-    return log(arg);
-  }
-  if (cstrncasecmp(*p, "log", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    double arg = parse_unary(p, x, e);
-    if (*e)
-      return NAN;
-    if (arg <= 0.0)
-      return NAN;
-    return log10(arg);
-  }
-  if (cstrncasecmp(*p, "abs", 3) == 0 && !isalpha(*(*p + 3))) {
-    *p += 3;
-    return fabs(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "floor", 5) == 0 && !isalpha(*(*p + 5))) {
-    *p += 5;
-    return floor(parse_unary(p, x, e));
-  }
-  if (cstrncasecmp(*p, "ceil", 4) == 0 && !isalpha(*(*p + 4))) {
-    *p += 4;
-    return ceil(parse_unary(p, x, e));
+  // identifiers are looked up whole, so sinh never reads as sin h
+  int len = 0;
+  while (isalpha((unsigned char)(*p)[len]))
+    len++;
+  if (len) {
+    const Builtin *bi = p_lookup(*p, len);
+    if (!bi)
+      return -1;
+    *p += len;
+    if (bi->arity == 0)
+      return p_node(pg, oNUM, -1, -1, bi->v);
+    int arg = parse_unary(p, pg);
+    if (arg < 0)
+      return -1;
+    return p_node(pg, bi->op, arg, -1, 0);
   }
 
   if (isdigit(**p) || **p == '.') {
@@ -221,109 +119,91 @@ static double parse_atom(const char **p, double x, int *e) {
       }
     }
 
-    if (!has_digits) {
-      *e = 1;
-      return NAN;
-    }
-    return val;
+    if (!has_digits)
+      return -1;
+    return p_node(pg, oNUM, -1, -1, val);
   }
 
-  *e = 1;
-  return NAN;
+  return -1;
 }
 
-static double parse_pf(const char **p, double x, int *error) {
-  double val = parse_atom(p, x, error);
-  if (*error)
-    return NAN;
+static int parse_pf(const char **p, Prog *pg) {
+  int val = parse_atom(p, pg);
+  if (val < 0)
+    return -1;
 
   swsp(p);
 
   while (**p == '!') {
     (*p)++;
-    val = factorial(val);
-    if (isnan(val) || isinf(val)) {
-      *error = 1;
-      return NAN;
-    }
+    val = p_node(pg, oFACT, val, -1, 0);
+    if (val < 0)
+      return -1;
     swsp(p);
   }
 
   return val;
 }
 
-static double parse_power(const char **p, double x, int *e) {
-  double val = parse_pf(p, x, e);
-  if (*e)
-    return NAN;
+static int parse_power(const char **p, Prog *pg) {
+  int val = parse_pf(p, pg);
+  if (val < 0)
+    return -1;
 
   swsp(p);
 
   if (**p == '^') {
     (*p)++;
-    double exponent = parse_power(p, x, e);
-    if (*e)
-      return NAN;
-    val = pow(val, exponent);
+    int exponent = parse_power(p, pg);
+    if (exponent < 0)
+      return -1;
+    val = p_node(pg, oPOW, val, exponent, 0);
   }
 
   return val;
 }
 
-static double parse_unary(const char **p, double x, int *e) {
+static int parse_unary(const char **p, Prog *pg) {
   swsp(p);
 
   if (**p == '-') {
     (*p)++;
-    return -parse_unary(p, x, e);
+    int val = parse_unary(p, pg);
+    if (val < 0)
+      return -1;
+    return p_node(pg, oNEG, val, -1, 0);
   } else if (**p == '+') {
     (*p)++;
-    return parse_unary(p, x, e);
+    return parse_unary(p, pg);
   }
 
-  return parse_power(p, x, e);
+  return parse_power(p, pg);
 }
 
-static double parse_factor(const char **p, double x, int *e) {
-  double val = parse_unary(p, x, e);
-  if (*e)
-    return NAN;
+static int parse_factor(const char **p, Prog *pg) {
+  int val = parse_unary(p, pg);
+  if (val < 0)
+    return -1;
 
   swsp(p);
 
   while (**p == '*' || **p == '/' || **p == '%' || isalnum(**p) || **p == '(') {
+    Op op = oMUL;
     if (**p == '*') {
       (*p)++;
-      double rhs = parse_unary(p, x, e);
-      if (*e)
-        return NAN;
-      val *= rhs;
     } else if (**p == '/') {
       (*p)++;
-      double divisor = parse_unary(p, x, e);
-      if (*e)
-        return NAN;
-      if (fabs(divisor) < 1e-15) {
-        *e = 1;
-        return NAN;
-      }
-      val /= divisor;
+      op = oDIV;
     } else if (**p == '%') {
       (*p)++;
-      double divisor = parse_unary(p, x, e);
-      if (*e)
-        return NAN;
-      if (fabs(divisor) < 1e-15) {
-        *e = 1;
-        return NAN;
-      }
-      val = fmod(val, divisor);
-    } else {
-      double rhs = parse_unary(p, x, e);
-      if (*e)
-        return NAN;
-      val *= rhs;
+      op = oMOD;
     }
+    int rhs = parse_unary(p, pg);
+    if (rhs < 0)
+      return -1;
+    val = p_node(pg, op, val, rhs, 0);
+    if (val < 0)
+      return -1;
 
     swsp(p);
   }
@@ -331,24 +211,23 @@ static double parse_factor(const char **p, double x, int *e) {
   return val;
 }
 
-static double parse_term(const char **p, double x, int *e) {
-  double val = parse_factor(p, x, e);
-  if (*e)
-    return NAN;
+static int parse_term(const char **p, Prog *pg) {
+  int val = parse_factor(p, pg);
+  if (val < 0)
+    return -1;
 
   swsp(p);
 
   while (**p == '+' || **p == '-') {
     char op = **p;
     (*p)++;
-    double rhs = parse_factor(p, x, e);
-    if (*e)
-      return NAN;
+    int rhs = parse_factor(p, pg);
+    if (rhs < 0)
+      return -1;
 
-    if (op == '+')
-      val += rhs;
-    else
-      val -= rhs;
+    val = p_node(pg, op == '+' ? oADD : oSUB, val, rhs, 0);
+    if (val < 0)
+      return -1;
 
     swsp(p);
   }
@@ -356,25 +235,71 @@ static double parse_term(const char **p, double x, int *e) {
   return val;
 }
 
-static double parse_expr(const char **p, double x, int *e) {
-  return parse_term(p, x, e);
+static int parse_expr(const char **p, Prog *pg) { return parse_term(p, pg); }
+
+static int tsize(const Prog *pg, int n) {
+  const CNode *nd = &pg->nodes[n];
+  return 1 + (nd->a >= 0 ? tsize(pg, nd->a) : 0) +
+         (nd->b >= 0 ? tsize(pg, nd->b) : 0);
 }
 
-double p_eval(const char *expr, double x) {
+static void emit(Prog *pg, int n, int depth) {
+  const CNode *nd = &pg->nodes[n];
+  if (nd->a >= 0)
+    emit(pg, nd->a, depth);
+  if (nd->b >= 0)
+    emit(pg, nd->b, depth + 1);
+  if (depth + 1 > pg->depth)
+    pg->depth = depth + 1;
+  pg->code[pg->len++] = (CInstr){nd->op, nd->v};
+}
+
+// (re)builds the postfix code from the tree at pg->root
+int p_emit(Prog *pg) {
+  free(pg->code);
+  pg->code = NULL;
+  pg->len = pg->depth = 0;
+  if (pg->root < 0)
+    return -1;
+  pg->code = malloc(tsize(pg, pg->root) * sizeof(CInstr));
+  if (!pg->code)
+    return -1;
+  emit(pg, pg->root, 0);
+  return 0;
+}
+
+Prog *p_compile(const char *expr) {
+  Prog *pg = calloc(1, sizeof(Prog));
+  if (!pg)
+    return NULL;
+  pg->root = -1;
   if (!expr || strlen(expr) == 0)
-    return NAN;
+    return pg;
 
   const char *p = expr;
-  int e = 0;
-
-  double result = parse_expr(&p, x, &e);
+  int root = parse_expr(&p, pg);
+  swsp(&p);
+  if (root < 0 || *p != '\0')
+    return pg;
 
-  if (e)
-    return NAN;
+  pg->root = root;
+  p_optimize(pg);
+  p_emit(pg);
+  return pg;
+}
 
-  swsp(&p);
-  if (*p != '\0')
-    return NAN;
+void p_free(Prog *pg) {
+  if (!pg)
+    return;
+  p_jit_free(pg);
+  free(pg->nodes);
+  free(pg->code);
+  free(pg);
+}
 
+double p_eval(const char *expr, double x) {
+  Prog *pg = p_compile(expr);
+  double result = p_run(pg, x);
+  p_free(pg);
   return result;
 }
@@ -3,6 +3,49 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "types.h"
+
 double p_eval(const char *f, double x);
 
+// compiled formulas
+Prog *p_compile(const char *f);
+double p_run(const Prog *pg, double x);
+void p_free(Prog *pg);
+Prog *p_deriv(const Prog *pg);
+
+// builtin functions and constants, p_lookup matches a whole identifier
+// case-insensitively
+extern const Builtin p_builtins[];
+extern const int p_nbuiltins;
+const Builtin *p_lookup(const char *s, int len);
+const Builtin *p_fn(Op op);
+int p_in_dom(Dom d, double a);
+
+// tree building, children must already be in pg->nodes. p_fold is p_node
+// with constant folding and algebraic simplification applied on the way
+int p_node(Prog *pg, Op op, int a, int b, double v);
+int p_fold(Prog *pg, Op op, int a, int b, double v);
+void p_optimize(Prog *pg);
+int p_emit(Prog *pg);
+int p_format(const Prog *pg, char *buf, int n);
+double p_op(Op op, double a, double b, int *e);
+
+// f, f' and f'' together by forward mode differentiation
+Dual p_dual(const Prog *pg, double x);
+void p_dual_batch(const Prog *pg, const double *xs, Dual *ys, int n);
+
+// native code, p_jit returns -1 and leaves pg interpreted when it can't
+int p_jit(Prog *pg);
+void p_jit_enable(int on);
+void p_jit_free(Prog *pg);
+void p_jit_run(const Prog *pg, const double *xs, double *ys, int m,
+               double *st);
+
+// enclosure of every finite value over x in [lo, hi]
+Ival p_ival(const Prog *pg, double lo, double hi);
+
+// batch evaluation, ys[i] = f(xs[i]) / ys[i] = f(a + (b - a) * i / n)
+void p_batch(const Prog *pg, const double *xs, double *ys, int n);
+void p_lin(const Prog *pg, double a, double b, int n, double *ys);
+
 #endif // !PARSER_H
@@ -0,0 +1,237 @@
+// Created by Unium on 18.10.26
+
+// png files written a few rows at a time. rows are filtered against the
+// one before (up) and the filtered bytes are cut into pieces of pngPiece
+// that are deflated on the pool, each primed with the window before it
+// and ended on a byte boundary, the way pigz does it. one after another
+// they make a single zlib stream, whose checksum is put together from
+// theirs. the pieces sit at fixed offsets of the stream, so the file is
+// the same for any number of threads or rows per call. only the pieces
+// in flight and a window are held however large the image is
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "png.h"
+#include "pool.h"
+
+#define pngPiece (1 << 17) // bytes of filtered rows deflated as one
+#define pngWindow 32768    // of deflate, the dictionary of a piece
+
+struct PngW {
+  FILE *f;
+  int w, h, row; // rows given so far
+  int level, err;
+  unsigned char *prev; // the last row given
+  unsigned char *buf;  // hist bytes already deflated, then len waiting
+  size_t hist, len, cap;
+  uLong adler; // of everything deflated
+};
+
+typedef struct {
+  const unsigned char *in;
+  size_t n, nd; // the piece, and the nd bytes before it as dictionary
+  int last;
+  unsigned char *out;
+  size_t nout;
+  uLong adler;
+  int err;
+} PPiece;
+
+typedef struct {
+  PPiece *pc;
+  int level;
+} PDeflate;
+
+typedef struct {
+  const PngW *p;
+  const unsigned char *rgb;
+  unsigned char *out;
+} PFilter;
+
+static void put32(unsigned char *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void chunk(PngW *p, const char *type, const unsigned char *d,
+                  uint32_t n) {
+  unsigned char b[8];
+  put32(b, n);
+  memcpy(b + 4, type, 4);
+  uLong crc = crc32(crc32(0, b + 4, 4), d, n);
+  unsigned char c[4];
+  put32(c, (uint32_t)crc);
+  if (fwrite(b, 1, 8, p->f) != 8 || fwrite(d, 1, n, p->f) != n ||
+      fwrite(c, 1, 4, p->f) != 4)
+    p->err = 1;
+}
+
+// one piece as raw deflate blocks. all but the last end with a sync
+// flush, so the next one starts on a byte of its own
+static void deflate_piece(void *arg, int i) {
+  PDeflate *j = arg;
+  PPiece *pc = &j->pc[i];
+  pc->adler = adler32(adler32(0, NULL, 0), pc->in, pc->n);
+  z_stream z = {0};
+  if (deflateInit2(&z, j->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    pc->err = 1;
+    return;
+  }
+  size_t cap = deflateBound(&z, pc->n) + 16;
+  pc->out = malloc(cap);
+  if (!pc->out ||
+      (pc->nd && deflateSetDictionary(&z, pc->in - pc->nd, pc->nd) != Z_OK)) {
+    pc->err = 1;
+    deflateEnd(&z);
+    return;
+  }
+  z.next_in = (Bytef *)pc->in;
+  z.avail_in = pc->n;
+  z.next_out = pc->out;
+  z.avail_out = cap;
+  int r = deflate(&z, pc->last ? Z_FINISH : Z_SYNC_FLUSH);
+  pc->err = pc->last ? r != Z_STREAM_END : r != Z_OK || z.avail_out == 0;
+  pc->nout = cap - z.avail_out;
+  deflateEnd(&z);
+}
+
+// deflates the whole pieces waiting, and the rest too as the end of the
+// stream when last is set. what was deflated goes out as IDAT in order
+static void flush(PngW *p, int last) {
+  int n = (int)(p->len / pngPiece) + (last && p->len % pngPiece);
+  if (last && n == 0)
+    n = 1; // an empty final block still ends the stream
+  PPiece *pc = calloc(n ? n : 1, sizeof(PPiece));
+  if (!pc) {
+    p->err = 1;
+    return;
+  }
+  size_t off = 0;
+  for (int i = 0; i < n; i++) {
+    size_t len = p->len - off < pngPiece ? p->len - off : pngPiece;
+    size_t before = p->hist + off;
+    size_t nd = before < pngWindow ? before : pngWindow;
+    pc[i] = (PPiece){.in = p->buf + before, .n = len, .nd = nd,
+                     .last = last && i == n - 1};
+    off += len;
+  }
+  PDeflate job = {pc, p->level};
+  t_for(n, deflate_piece, &job);
+  for (int i = 0; i < n; i++) {
+    p->err |= pc[i].err;
+    if (!p->err) {
+      chunk(p, "IDAT", pc[i].out, pc[i].nout);
+      p->adler = adler32_combine(p->adler, pc[i].adler, pc[i].n);
+    }
+    free(pc[i].out);
+  }
+  free(pc);
+
+  // the last window of what went out stays as the next dictionary
+  size_t keep = p->hist + off < pngWindow ? p->hist + off : pngWindow;
+  memmove(p->buf, p->buf + p->hist + off - keep, keep + p->len - off);
+  p->hist = keep;
+  p->len -= off;
+}
+
+static void filter_row(void *arg, int y) {
+  PFilter *j = arg;
+  size_t n = (size_t)j->p->w * 3;
+  const unsigned char *r = j->rgb + n * y;
+  const unsigned char *up = y ? r - n : j->p->prev;
+  unsigned char *o = j->out + (n + 1) * y;
+  o[0] = 2; // up
+  for (size_t i = 0; i < n; i++)
+    o[i + 1] = r[i] - up[i];
+}
+
+PngW *png_open(const char *f_name, int w, int h, int level) {
+  if (w <= 0 || h <= 0)
+    return NULL;
+  PngW *p = calloc(1, sizeof(PngW));
+  if (!p)
+    return NULL;
+  p->w = w;
+  p->h = h;
+  p->level = level;
+  p->adler = adler32(0, NULL, 0);
+  p->prev = calloc((size_t)w * 3, 1);
+  p->f = p->prev ? fopen(f_name, "wb") : NULL;
+  if (!p->f) {
+    free(p->prev);
+    free(p);
+    return NULL;
+  }
+
+  static const unsigned char sig[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+  unsigned char ihdr[13] = {0};
+  put32(ihdr, w);
+  put32(ihdr + 4, h);
+  ihdr[8] = 8; // bits per channel
+  ihdr[9] = 2; // rgb
+  if (fwrite(sig, 1, 8, p->f) != 8)
+    p->err = 1;
+  chunk(p, "IHDR", ihdr, 13);
+  // the zlib header, 32k window and the level as a hint
+  int hint = level < 0 || level == 6 ? 2 : level < 2 ? 0 : level < 6 ? 1 : 3;
+  unsigned char zh[2] = {0x78, hint << 6};
+  zh[1] += 31 - (zh[0] * 256 + zh[1]) % 31;
+  chunk(p, "IDAT", zh, 2);
+  return p;
+}
+
+// the next rows of the image, w * 3 bytes each
+int png_rows(PngW *p, const unsigned char *rgb, int rows) {
+  size_t n = (size_t)p->w * 3;
+  if (rows > p->h - p->row)
+    rows = p->h - p->row;
+  if (p->err || rows <= 0)
+    return p->err ? -1 : 0;
+  size_t need = p->hist + p->len + (n + 1) * rows;
+  if (need > p->cap) {
+    unsigned char *b = realloc(p->buf, need);
+    if (!b) {
+      p->err = 1;
+      return -1;
+    }
+    p->buf = b;
+    p->cap = need;
+  }
+  PFilter job = {p, rgb, p->buf + p->hist + p->len};
+  t_for(rows, filter_row, &job);
+  memcpy(p->prev, rgb + n * (rows - 1), n);
+  p->row += rows;
+  p->len += (n + 1) * rows;
+  if (p->len >= pngPiece)
+    flush(p, 0);
+  return p->err ? -1 : 0;
+}
+
+// finishes the file, 0 when every row was given and all of it written
+int png_close(PngW *p) {
+  if (!p)
+    return -1;
+  if (!p->err && p->row == p->h) {
+    flush(p, 1);
+    unsigned char a[4];
+    put32(a, (uint32_t)p->adler);
+    chunk(p, "IDAT", a, 4);
+    chunk(p, "IEND", (const unsigned char *)"", 0);
+  } else {
+    p->err = 1;
+  }
+  if (fclose(p->f) != 0)
+    p->err = 1;
+  int r = p->err ? -1 : 0;
+  free(p->prev);
+  free(p->buf);
+  free(p);
+  return r;
+}
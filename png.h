@@ -0,0 +1,15 @@
+// Created by Unium on 18.10.26
+
+#ifndef PNG_H
+#define PNG_H
+
+// an 8 bit rgb png written top to bottom, any number of rows at a time.
+// level is zlib's, 0 to 9 or -1 for its default
+
+typedef struct PngW PngW;
+
+PngW *png_open(const char *f_name, int w, int h, int level);
+int png_rows(PngW *p, const unsigned char *rgb, int rows);
+int png_close(PngW *p);
+
+#endif // !PNG_H
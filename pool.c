@@ -0,0 +1,149 @@
+// Created by Unium on 18.10.26
+
+// each thread starts on an even share of the loop and takes from its
+// front. one that runs dry steals from the back of the others' shares, so
+// uneven tasks (a pole that splits every column, a function far more
+// expensive than the rest) still spread over all of them
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "kern.h"
+#include "pool.h"
+
+#define tMax 64
+
+// lo in the low half, hi in the high half, padded to a cache line
+typedef struct {
+  _Atomic uint64_t range;
+  char pad[56];
+} Share;
+
+static Share shares[tMax];
+static pthread_t workers[tMax];
+static int threads = 1;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t loop = PTHREAD_MUTEX_INITIALIZER; // one at a time
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static TFn job;
+static void *job_arg;
+static unsigned long gen;  // bumped for every loop
+static unsigned long born; // gen when the workers were started
+static int busy;           // workers still on the current loop
+static int stopping;
+
+// set in the workers and in a thread inside t_for, a loop started from a
+// task runs right there
+static _Thread_local int inside;
+
+static int take(Share *s, int back, int *i) {
+  uint64_t r = atomic_load(&s->range);
+  for (;;) {
+    uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+    if (lo >= hi)
+      return 0;
+    uint64_t nr = back ? (uint64_t)(hi - 1) << 32 | lo
+                       : (uint64_t)hi << 32 | (lo + 1);
+    if (atomic_compare_exchange_weak(&s->range, &r, nr)) {
+      *i = back ? (int)hi - 1 : (int)lo;
+      return 1;
+    }
+  }
+}
+
+static void work(int id, TFn fn, void *arg) {
+  int i;
+  while (take(&shares[id], 0, &i))
+    fn(arg, i);
+  for (int k = 1; k < threads; k++) {
+    Share *s = &shares[(id + k) % threads];
+    while (take(s, 1, &i))
+      fn(arg, i);
+  }
+}
+
+static void *worker(void *p) {
+  int id = (int)(intptr_t)p;
+  unsigned long seen = born;
+  inside = 1;
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (gen == seen && !stopping)
+      pthread_cond_wait(&wake, &lock);
+    if (stopping)
+      break;
+    seen = gen;
+    TFn fn = job;
+    void *arg = job_arg;
+    pthread_mutex_unlock(&lock);
+    work(id, fn, arg);
+    pthread_mutex_lock(&lock);
+    if (--busy == 0)
+      pthread_cond_signal(&done);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+void t_start(int n) {
+  if (n <= 0)
+    n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n > tMax)
+    n = tMax;
+  // settle the kernel choice before the workers can race for it
+  k_get();
+  born = gen;
+  threads = 1;
+  for (int i = 1; i < n; i++) {
+    if (pthread_create(&workers[i], NULL, worker, (void *)(intptr_t)i) != 0)
+      break;
+    threads++;
+  }
+}
+
+void t_stop(void) {
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  for (int i = 1; i < threads; i++)
+    pthread_join(workers[i], NULL);
+  threads = 1;
+  stopping = 0;
+}
+
+int t_threads(void) { return threads; }
+
+void t_for(int n, TFn fn, void *arg) {
+  // a loop while another thread has the pool runs right there as well
+  if (threads <= 1 || n <= 1 || inside || pthread_mutex_trylock(&loop) != 0) {
+    for (int i = 0; i < n; i++)
+      fn(arg, i);
+    return;
+  }
+  for (int t = 0; t < threads; t++) {
+    uint64_t lo = (uint64_t)n * t / threads;
+    uint64_t hi = (uint64_t)n * (t + 1) / threads;
+    atomic_store(&shares[t].range, hi << 32 | lo);
+  }
+  pthread_mutex_lock(&lock);
+  job = fn;
+  job_arg = arg;
+  busy = threads - 1;
+  gen++;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  inside = 1;
+  work(0, fn, arg);
+  inside = 0;
+  pthread_mutex_lock(&lock);
+  while (busy)
+    pthread_cond_wait(&done, &lock);
+  pthread_mutex_unlock(&lock);
+  pthread_mutex_unlock(&loop);
+}
@@ -0,0 +1,20 @@
+// Created by Unium on 18.10.26
+
+#ifndef POOL_H
+#define POOL_H
+
+// fixed pool of worker threads for parallel loops. t_for runs fn(arg, i)
+// for every i in [0, n) on the workers and the calling thread and returns
+// once all are done. any thread may run any i, so a task only writes what
+// belongs to its i and results that get combined are combined by the
+// caller in order of i, which keeps them the same for any thread count.
+// a loop started while another thread has the pool runs on its caller
+
+typedef void (*TFn)(void *arg, int i);
+
+void t_start(int threads); // 0 for one per cpu
+void t_stop(void);
+int t_threads(void);
+void t_for(int n, TFn fn, void *arg);
+
+#endif // !POOL_H
@@ -0,0 +1,688 @@
+// Created by Unium on 18.10.26
+
+// the plot as cells in memory, with nothing of the terminal in it: the
+// layers and curves, the overlays and the exporters. the ncurses views in
+// graph.c and the render thread only show or hand on what d_render draws
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maths.h"
+#include "parser.h"
+#include "pool.h"
+#include "raster.h"
+#include "types.h"
+
+#define envSplit 8    // pieces a wide column is split into
+#define envSamples 4  // point samples per piece that stays too wide
+#define frameBudget 8 // evaluations per plot column per frame, shared
+#define envChunk 16   // envelope columns per task of the pool
+
+// sizes fb to w x h, reallocating only when that changed, and clears it.
+// returns -1 when there is nothing to draw into
+int d_frame_reset(PFrame *fb, int w, int h) {
+  if (w <= 0 || h <= 0) {
+    fb->w = fb->h = 0;
+    return -1;
+  }
+  size_t n = (size_t)w * h;
+  if (w != fb->w || h != fb->h || !fb->glyph) {
+    free(fb->glyph);
+    // glyphs, colours and attributes back to back, then the same as drawn
+    fb->glyph = malloc(n * 6);
+    if (!fb->glyph) {
+      fb->w = fb->h = 0;
+      return -1;
+    }
+    fb->col = (unsigned char *)fb->glyph + n;
+    fb->attr = fb->col + n;
+    fb->prev = fb->attr + n;
+    fb->w = w;
+    fb->h = h;
+    fb->valid = 0;
+  }
+  memset(fb->glyph, ' ', n);
+  memset(fb->col, 0, n * 2);
+  return 0;
+}
+
+static void frame_free(PFrame *fb) {
+  free(fb->glyph);
+  *fb = (PFrame){0};
+}
+
+// index of the cell at column x, plot row py (counted up from the bottom)
+static int cell(const PFrame *fb, int x, int py) {
+  return (fb->h - 1 - py) * fb->w + x;
+}
+
+// marks a cell of the curve if it is on the plot
+static void plot_cell(PFrame *fb, int px, int py, int color) {
+  if (px >= 0 && px < fb->w && py >= 0 && py < fb->h) {
+    fb->glyph[cell(fb, px, py)] = '*';
+    fb->col[cell(fb, px, py)] = color;
+  }
+}
+
+// the curve through the points p (from sample_curve), joined by straight
+// lines in cell space except across a break
+static void plot_points(PFrame *fb, const SPoint *p, int n, const PView *v,
+                        int color) {
+  int plot_W = fb->w, plot_H = fb->h;
+  double sx = plot_W / (v->mmX - v->mX), sy = plot_H / (v->mmY - v->mY);
+
+  for (int i = 0; i < n; i++) {
+    if (!isfinite(p[i].y))
+      continue;
+    double x0 = (p[i].x - v->mX) * sx, y0 = (p[i].y - v->mY) * sy;
+    plot_cell(fb, (int)floor(x0), (int)floor(y0), color);
+    if (i == n - 1 || p[i].brk || !isfinite(p[i + 1].y))
+      continue;
+    double x1 = (p[i + 1].x - v->mX) * sx, y1 = (p[i + 1].y - v->mY) * sy;
+    // clip to a row past either edge, so a steep piece costs at most the
+    // plot height in steps
+    double t0 = 0, t1 = 1;
+    if (y1 != y0) {
+      double ta = (-1 - y0) / (y1 - y0), tb = (plot_H + 1 - y0) / (y1 - y0);
+      t0 = fmax(t0, fmin(ta, tb));
+      t1 = fmin(t1, fmax(ta, tb));
+    } else if (y0 < -1 || y0 > plot_H + 1) {
+      continue;
+    }
+    if (t0 > t1)
+      continue;
+    double ax = x0 + (x1 - x0) * t0, ay = y0 + (y1 - y0) * t0;
+    double bx = x0 + (x1 - x0) * t1, by = y0 + (y1 - y0) * t1;
+    int steps = (int)ceil(fmax(fabs(bx - ax), fabs(by - ay)));
+    for (int s = 1; s <= steps; s++) {
+      double t = (double)s / steps;
+      plot_cell(fb, (int)floor(ax + (bx - ax) * t),
+                (int)floor(ay + (by - ay) * t), color);
+    }
+  }
+}
+
+// fills rows lo..hi (in plot coordinates) of column px
+static void plot_run(PFrame *fb, int px, int lo, int hi, int color) {
+  for (int py = lo < 0 ? 0 : lo; py <= hi && py < fb->h; py++)
+    plot_cell(fb, px, py, color);
+}
+
+// what the envelope knows about one column: the enclosure of f over the
+// whole column and, once it had to be split, over each of its pieces.
+// pieces too wide for a run get point samples, flagged in sampled
+typedef struct {
+  int have, split, sampled;
+  Ival r;
+  Ival q[envSplit];
+  double ys[envSplit][envSamples];
+} EnvCol;
+
+// column px of the curve as a vertical run, an interval enclosure of f
+// over the column's x range, so nothing between samples is missed. a
+// column that spans more than a couple of rows is split into pieces to
+// tighten the enclosure, and a piece that still reaches far past the view
+// (a pole or a badly overestimated range) is point sampled instead. a
+// coarse column is the whole column's run and never split. only what c
+// does not hold yet is evaluated, returns how many evaluations that took
+static int env_column(PFrame *fb, EnvCol *c, const Prog *prog,
+                      const PView *v, int px, int color, int coarse) {
+  int plot_H = fb->h, evals = 0;
+  double dx = (v->mmX - v->mX) / fb->w, dy = v->mmY - v->mY;
+  double x0 = v->mX + dx * px;
+  if (!c->have) {
+    c->r = p_ival(prog, x0, x0 + dx);
+    c->have = 1;
+    evals++;
+  }
+  Ival r = c->r;
+  if (!(r.lo <= r.hi) || r.hi < v->mY || r.lo >= v->mmY)
+    return evals;
+  if (coarse) {
+    plot_run(fb, px, (int)floor((fmax(r.lo, v->mY) - v->mY) / dy * plot_H),
+             (int)floor((fmin(r.hi, v->mmY) - v->mY) / dy * plot_H), color);
+    return evals;
+  }
+  // rows as doubles first, an unbounded or huge enclosure is split, and
+  // one short enough to draw meets the view so its rows fit an int
+  double lo = floor((r.lo - v->mY) / dy * plot_H);
+  double hi = floor((r.hi - v->mY) / dy * plot_H);
+  if (isfinite(lo) && isfinite(hi) && hi - lo <= 2) {
+    plot_run(fb, px, (int)lo, (int)hi, color);
+    return evals;
+  }
+
+  if (!c->split) {
+    for (int k = 0; k < envSplit; k++)
+      c->q[k] = p_ival(prog, x0 + dx * k / envSplit,
+                       x0 + dx * (k + 1) / envSplit);
+    c->split = 1;
+    evals += envSplit;
+  }
+  for (int k = 0; k < envSplit; k++) {
+    Ival q = c->q[k];
+    if (!(q.lo <= q.hi) || q.hi < v->mY || q.lo >= v->mmY)
+      continue;
+    if (isfinite(q.lo) && isfinite(q.hi) && q.hi - q.lo <= 4 * dy) {
+      plot_run(fb, px, (int)floor((q.lo - v->mY) / dy * plot_H),
+               (int)floor((q.hi - v->mY) / dy * plot_H), color);
+      continue;
+    }
+    if (!(c->sampled >> k & 1)) {
+      double a = x0 + dx * k / envSplit, b = x0 + dx * (k + 1) / envSplit;
+      double xs[envSamples];
+      for (int i = 0; i < envSamples; i++)
+        xs[i] = a + (b - a) * (i + 0.5) / envSamples;
+      p_batch(prog, xs, c->ys[k], envSamples);
+      c->sampled |= 1 << k;
+      evals += envSamples;
+    }
+    for (int i = 0; i < envSamples; i++) {
+      double py = floor((c->ys[k][i] - v->mY) / dy * plot_H);
+      if (py >= 0 && py < plot_H)
+        plot_cell(fb, px, (int)py, color);
+    }
+  }
+  return evals;
+}
+
+static void plot_axes(PFrame *fb, const PView *v) {
+  int plot_W = fb->w, plot_H = fb->h;
+  int zero_y = (int)((0 - v->mY) / (v->mmY - v->mY) * plot_H);
+  int zero_x = (int)((0 - v->mX) / (v->mmX - v->mX) * plot_W);
+  if (zero_y >= 0 && zero_y < plot_H) {
+    memset(fb->glyph + cell(fb, 0, zero_y), '-', plot_W);
+  }
+  if (zero_x >= 0 && zero_x < plot_W) {
+    for (int y = 0; y < plot_H; y++)
+      fb->glyph[y * plot_W + zero_x] = '|';
+  }
+  if (zero_y >= 0 && zero_y < plot_H && zero_x >= 0 && zero_x < plot_W) {
+    fb->glyph[cell(fb, zero_x, zero_y)] = '+';
+  }
+}
+
+// shades the area between the curve and y = 0 over [a, b]
+static void plot_fill(PFrame *fb, const Prog *prog, const PView *v, double a,
+                      double b) {
+  int plot_W = fb->w, plot_H = fb->h;
+  double a_px = (a - v->mX) / (v->mmX - v->mX) * plot_W;
+  double b_px = (b - v->mX) / (v->mmX - v->mX) * plot_W;
+  int start_px = (int)fmin(a_px, b_px);
+  int end_px = (int)fmax(a_px, b_px);
+  if (start_px < 0)
+    start_px = 0;
+  if (end_px >= plot_W)
+    end_px = plot_W - 1;
+
+  int n = end_px >= start_px ? end_px - start_px + 1 : 0;
+  double *xs = malloc((n + 1) * sizeof(double));
+  double *ys = malloc((n + 1) * sizeof(double));
+  if (!xs || !ys) {
+    free(xs);
+    free(ys);
+    return;
+  }
+  for (int px = start_px; px <= end_px; px++)
+    xs[px - start_px] = v->mX + (v->mmX - v->mX) * px / plot_W;
+  p_batch(prog, xs, ys, n);
+  for (int px = start_px; px <= end_px; px++) {
+    double val_Y = ys[px - start_px];
+    if (isnan(val_Y) || isinf(val_Y))
+      continue;
+    int py = (int)((val_Y - v->mY) / (v->mmY - v->mY) * plot_H);
+    int zero_py = (int)((0 - v->mY) / (v->mmY - v->mY) * plot_H);
+    int start_Y = fmin(py, zero_py);
+    int end_Y = fmax(py, zero_py);
+    for (int fill_y = start_Y; fill_y <= end_Y; fill_y++) {
+      if (fill_y >= 0 && fill_y < plot_H)
+        fb->glyph[cell(fb, px, fill_y)] = '.';
+    }
+  }
+  free(xs);
+  free(ys);
+}
+
+// what a layer was drawn from. compared whole, so built from a zeroed key
+typedef struct {
+  double mX, mmX, mY, mmY;
+  double a, b;
+  int w, h, envelope;
+  int col, budget;
+  int pass; // of the refinement, 0 for full detail
+  char formula[mmFormulaLen];
+} LKey;
+
+// a cached layer of the plot, spaces in its frame let the layers below
+// show through. a curve also keeps what it was drawn from, so a view that
+// only moved can reuse it
+typedef struct {
+  PFrame fb;
+  LKey key;
+  int evals;
+  SPoint *pts; // sampled curves, npts points in graph coordinates
+  int npts;
+  EnvCol *env; // envelope curves, one per column
+  int cut;     // left half drawn by a frame that was cancelled
+} PLayer;
+
+// the layers bottom up, and base, the layers composited. only the
+// overlays (tangent and trace marker) are drawn on top each frame
+typedef struct PLayers {
+  PLayer axes, fill, curves[mmFuncs];
+  PFrame base;
+} PLayers;
+
+static LKey layer_key(const PFrame *fb, const PView *v) {
+  LKey k;
+  memset(&k, 0, sizeof(k));
+  k.mX = v->mX;
+  k.mmX = v->mmX;
+  k.mY = v->mY;
+  k.mmY = v->mmY;
+  k.w = fb->w;
+  k.h = fb->h;
+  k.envelope = v->envelope;
+  return k;
+}
+
+// readies l for k, 1 when it has to be redrawn. it is then cleared, or
+// left without a frame (w = 0) when out of memory
+static int layer_stale(PLayer *l, const LKey *k) {
+  if (l->fb.glyph && !l->cut && memcmp(&l->key, k, sizeof(*k)) == 0)
+    return 0;
+  l->cut = 0;
+  l->key = *k;
+  l->evals = 0;
+  d_frame_reset(&l->fb, k->w, k->h);
+  return 1;
+}
+
+// the whole columns and rows the view of b lies from that of a, when the
+// two only differ by such a move and the refinement pass
+static int layer_shift(const LKey *a, const LKey *b, int *cx, int *cy) {
+  LKey p = *a, q = *b;
+  p.mX = p.mmX = p.mY = p.mmY = 0;
+  q.mX = q.mmX = q.mY = q.mmY = 0;
+  p.pass = q.pass = 0;
+  if (memcmp(&p, &q, sizeof(p)) != 0)
+    return 0;
+  double dx = (a->mmX - a->mX) / a->w, dy = (a->mmY - a->mY) / a->h;
+  double sx = (b->mX - a->mX) / dx, sy = (b->mY - a->mY) / dy;
+  if (!(fabs(sx) < a->w) || !(fabs(sy) < 1e9))
+    return 0;
+  *cx = (int)lround(sx);
+  *cy = (int)lround(sy);
+  return fabs(sx - *cx) < 1e-6 && fabs(sy - *cy) < 1e-6 &&
+         fabs(b->mmX - b->mX - (a->mmX - a->mX)) < 1e-6 * dx &&
+         fabs(b->mmY - b->mY - (a->mmY - a->mY)) < 1e-6 * dy;
+}
+
+static void curve_free(PLayer *l) {
+  free(l->pts);
+  free(l->env);
+  l->pts = NULL;
+  l->env = NULL;
+  l->npts = 0;
+}
+
+// the points kept from a sampled curve that moved cx columns, with the
+// newly exposed strip sampled on the side it came in from
+static void curve_strip(PLayer *l, const Prog *prog, const PView *v, int cx,
+                        int budget) {
+  int w = l->fb.w, n = abs(cx);
+  double dx = (v->mmX - v->mX) / w;
+  PView s = *v;
+  if (cx > 0)
+    s.mX = v->mmX - n * dx;
+  else
+    s.mmX = v->mX + n * dx;
+  SPoint *sp;
+  int m = sample_curve(prog, &s, n, l->fb.h, budget * n / w, &sp, &l->evals);
+  if (m == 0) {
+    curve_free(l);
+    return;
+  }
+
+  // the old points up to the strip, and one past the other edge so the
+  // line into the view stays
+  double lo = cx > 0 ? v->mX : s.mmX, hi = cx > 0 ? s.mX : v->mmX;
+  int i0 = 0, i1 = l->npts;
+  while (i0 < l->npts && l->pts[i0].x < lo)
+    i0++;
+  while (i1 > i0 && l->pts[i1 - 1].x > hi)
+    i1--;
+  if (cx > 0 && i0 > 0)
+    i0--;
+  if (cx < 0 && i1 < l->npts)
+    i1++;
+  SPoint *p = malloc((i1 - i0 + m) * sizeof(SPoint));
+  if (!p) {
+    free(sp);
+    curve_free(l);
+    return;
+  }
+  SPoint *o = p;
+  if (cx < 0) {
+    memcpy(o, sp, m * sizeof(SPoint));
+    o += m;
+  }
+  memcpy(o, l->pts + i0, (i1 - i0) * sizeof(SPoint));
+  o += i1 - i0;
+  if (cx > 0)
+    memcpy(o, sp, m * sizeof(SPoint));
+  free(sp);
+  free(l->pts);
+  l->pts = p;
+  l->npts = i1 - i0 + m;
+}
+
+// one piece of a curve layer update for the pool: a range of envelope
+// columns, or a whole sampled curve
+typedef struct {
+  PLayer *l;
+  const Prog *prog;
+  int px0, px1; // envelope columns, px1 = 0 for a sampled curve
+  int keep, cx; // sampled points kept, and the columns they moved
+  int evals;
+  int cut; // skipped for a newer frame
+} CTask;
+
+typedef struct {
+  CTask *t;
+  const PView *v;
+  int (*cancel)(void);
+} CJob;
+
+// readies curve layer l for k and puts the work of redrawing it in t,
+// returns how many tasks that is. when the view only moved by whole
+// columns or rows what is still in view is reused: envelope columns shift
+// along and sampled points are kept, and only the newly exposed columns
+// are evaluated. a vertical move just maps the same samples to new rows,
+// apart from envelope columns that come into view split for the first time
+static int curve_prep(PLayer *l, const LKey *k, const Prog *prog,
+                      const PView *v, CTask *t) {
+  // envelope columns only lack their splits after a coarse pass, sampled
+  // points of another pass are drawn again from the tile cache
+  int cx = 0, cy = 0;
+  int keep = l->fb.glyph && (l->pts || l->env) &&
+             (v->envelope || l->key.pass == k->pass) &&
+             layer_shift(&l->key, k, &cx, &cy);
+  layer_stale(l, k);
+  int w = l->fb.w;
+  if (!k->col || !w) {
+    curve_free(l);
+    return 0;
+  }
+
+  if (v->envelope) {
+    if (!keep) {
+      curve_free(l);
+      l->env = calloc(w, sizeof(EnvCol));
+      if (!l->env)
+        return 0;
+    } else if (cx > 0) {
+      memmove(l->env, l->env + cx, (w - cx) * sizeof(EnvCol));
+      memset(l->env + w - cx, 0, cx * sizeof(EnvCol));
+    } else if (cx < 0) {
+      memmove(l->env - cx, l->env, (w + cx) * sizeof(EnvCol));
+      memset(l->env, 0, -cx * sizeof(EnvCol));
+    }
+    int n = 0;
+    for (int px = 0; px < w; px += envChunk)
+      t[n++] = (CTask){l, prog, px, px + envChunk < w ? px + envChunk : w,
+                       0, 0, 0, 0};
+    return n;
+  }
+
+  if (!keep)
+    curve_free(l);
+  t[0] = (CTask){l, prog, 0, 0, keep, cx, 0, 0};
+  return 1;
+}
+
+// each task only draws into its own columns or its own layer. once the
+// frame is cancelled the rest are skipped: envelope columns not drawn yet
+// are still empty and get done next time, points kept from a shifted
+// view no longer match the key and are dropped
+static void curve_task(void *arg, int i) {
+  CJob *j = arg;
+  CTask *t = &j->t[i];
+  PLayer *l = t->l;
+  if (j->cancel && j->cancel()) {
+    if (!t->px1)
+      curve_free(l);
+    t->cut = 1;
+    return;
+  }
+  if (t->px1) {
+    for (int px = t->px0; px < t->px1; px++)
+      t->evals += env_column(&l->fb, &l->env[px], t->prog, j->v, px,
+                             l->key.col, l->key.pass > 0);
+    return;
+  }
+  if (!t->keep)
+    l->npts = sample_curve(t->prog, j->v, l->fb.w, l->fb.h, l->key.budget,
+                           &l->pts, &l->evals);
+  else if (t->cx)
+    curve_strip(l, t->prog, j->v, t->cx, l->key.budget);
+  plot_points(&l->fb, l->pts, l->npts, j->v, l->key.col);
+}
+
+// lays the opaque cells of l over fb, only onto blanks when under is set
+static void layer_over(PFrame *fb, const PLayer *l, int under) {
+  if (!l->fb.glyph)
+    return;
+  for (int i = 0; i < fb->w * fb->h; i++) {
+    if (l->fb.glyph[i] != ' ' && (!under || fb->glyph[i] == ' ')) {
+      fb->glyph[i] = l->fb.glyph[i];
+      fb->col[i] = l->fb.col[i];
+    }
+  }
+}
+
+void d_frame_free(PFrame *fb) {
+  PLayers *L = fb->layers;
+  if (L) {
+    frame_free(&L->axes.fb);
+    frame_free(&L->fill.fb);
+    for (int f = 0; f < mmFuncs; f++) {
+      frame_free(&L->curves[f].fb);
+      curve_free(&L->curves[f]);
+    }
+    frame_free(&L->base);
+    free(L);
+  }
+  frame_free(fb);
+}
+
+// forgets what the layers of fb were drawn from but keeps their memory, so
+// the next d_render draws it all afresh and nothing of an earlier scene
+// carries over
+void d_frame_forget(PFrame *fb) {
+  PLayers *L = fb->layers;
+  if (!L)
+    return;
+  memset(&L->axes.key, 0, sizeof(LKey));
+  memset(&L->fill.key, 0, sizeof(LKey));
+  for (int f = 0; f < mmFuncs; f++) {
+    curve_free(&L->curves[f]);
+    memset(&L->curves[f].key, 0, sizeof(LKey));
+  }
+}
+
+// brings the cached layers of the plot up to date with s and composites
+// them into base if any changed. curves are drawn at the refinement pass
+// of s unless they already have more detail, s->more is set when some are
+// left coarse. NULL when out of memory or cancelled
+static PFrame *plot_base(PFrame *fb, PScene *s) {
+  FLists *funcs = &s->funcs;
+  PView *v = &s->v;
+  IntegrationState *integ = &s->integ;
+  int pass = s->pass;
+  if (!fb->layers)
+    fb->layers = calloc(1, sizeof(PLayers));
+  PLayers *L = fb->layers;
+  if (!L)
+    return NULL;
+  LKey view = layer_key(fb, v), k;
+  int dirty = 0;
+
+  if (layer_stale(&L->axes, &view)) {
+    if (L->axes.fb.w)
+      plot_axes(&L->axes.fb, v);
+    dirty = 1;
+  }
+
+  k = view;
+  if (integ->active) {
+    k.a = integ->a;
+    k.b = integ->b;
+    strcpy(k.formula, funcs->functions[funcs->sel].formula);
+  }
+  if (layer_stale(&L->fill, &k)) {
+    if (integ->active && L->fill.fb.w)
+      plot_fill(&L->fill.fb, f_prog(&funcs->functions[funcs->sel]), v,
+                integ->a, integ->b);
+    dirty = 1;
+  }
+
+  // the curves that changed are redrawn together on the pool
+  CTask *tasks = malloc(mmFuncs * (fb->w / envChunk + 1) * sizeof(CTask));
+  if (!tasks)
+    return NULL;
+  int ntasks = 0, shown = 0;
+  for (int f = 0; f < funcs->count; f++)
+    shown += funcs->functions[f].active;
+  for (int f = 0; f < mmFuncs; f++) {
+    F *fn = &funcs->functions[f];
+    PLayer *l = &L->curves[f];
+    k = view;
+    if (f < funcs->count && fn->active) {
+      k.col = fn->col;
+      k.budget = v->envelope ? 0 : fb->w * frameBudget / shown >> 2 * pass;
+      k.pass = pass;
+      strcpy(k.formula, fn->formula);
+      // one with more detail that only has to move stays at it
+      LKey m = k;
+      int cx, cy;
+      m.budget = l->key.budget;
+      m.pass = l->key.pass;
+      if (l->fb.glyph && !l->cut && m.pass < pass &&
+          layer_shift(&l->key, &m, &cx, &cy))
+        k = m;
+      s->more |= k.pass > 0;
+    }
+    if (!l->fb.glyph || l->cut || memcmp(&l->key, &k, sizeof(k)) != 0) {
+      const Prog *prog = k.col ? f_prog(fn) : NULL;
+      ntasks += curve_prep(l, &k, prog, v, tasks + ntasks);
+      dirty = 1;
+    }
+  }
+  CJob job = {tasks, v, s->cancel};
+  t_for(ntasks, curve_task, &job);
+  int cut = 0;
+  for (int i = 0; i < ntasks; i++) {
+    tasks[i].l->evals += tasks[i].evals;
+    tasks[i].l->cut |= tasks[i].cut;
+    cut |= tasks[i].cut;
+  }
+  free(tasks);
+  for (int f = 0; f < funcs->count; f++)
+    funcs->functions[f].evals = L->curves[f].evals;
+
+  if (cut)
+    return NULL;
+  if (!dirty && L->base.glyph)
+    return &L->base;
+  if (d_frame_reset(&L->base, fb->w, fb->h) != 0)
+    return NULL;
+  // the fill only shows on blanks, the curves cover everything
+  layer_over(&L->base, &L->axes, 0);
+  layer_over(&L->base, &L->fill, 1);
+  for (int f = 0; f < funcs->count; f++)
+    if (L->curves[f].key.col)
+      layer_over(&L->base, &L->curves[f], 0);
+  return &L->base;
+}
+
+// draws the plot of s into fb, s->w by s->h cells, without touching the
+// screen. the layers are cached in fb. 0 when done, -1 when out of memory
+// or cancelled for a newer frame
+int d_render(PFrame *fb, PScene *s) {
+  FLists *funcs = &s->funcs;
+  PView *v = &s->v;
+  s->trace_Y = NAN;
+  s->more = 0;
+  if (d_frame_reset(fb, s->w, s->h) != 0 || funcs->count == 0)
+    return 0;
+  int plot_W = fb->w, plot_H = fb->h;
+  PFrame *base = plot_base(fb, s);
+  if (!base)
+    return -1;
+  memcpy(fb->glyph, base->glyph, (size_t)plot_W * plot_H);
+  memcpy(fb->col, base->col, (size_t)plot_W * plot_H);
+  char *buff = fb->glyph;
+  double trace_X = s->trace_X, trace_slope = s->trace_slope, trace_Y = NAN;
+  if (s->trace_mode)
+    trace_Y = p_run(f_prog(&funcs->functions[funcs->sel]), trace_X);
+  s->trace_Y = trace_Y;
+  if (s->trace_mode && s->show_deriv && !isnan(trace_slope)) {
+    if (!isnan(trace_Y)) {
+      for (int px = 0; px < plot_W; px++) {
+        double x = v->mX + (v->mmX - v->mX) * px / plot_W;
+        double tang_Y = trace_Y + trace_slope * (x - trace_X);
+        int py = (int)((tang_Y - v->mY) / (v->mmY - v->mY) * plot_H);
+        if (py >= 0 && py < plot_H) {
+          int i = cell(fb, px, py);
+          if (buff[i] == ' ' || buff[i] == '-' || buff[i] == '|') {
+            buff[i] = ':';
+            fb->col[i] = 3;
+          }
+        }
+      }
+    }
+  }
+  if (s->trace_mode) {
+    if (!isnan(trace_Y) && !isinf(trace_Y)) {
+      int trace_px = (int)((trace_X - v->mX) / (v->mmX - v->mX) * plot_W);
+      int trace_py = (int)((trace_Y - v->mY) / (v->mmY - v->mY) * plot_H);
+      if (trace_px >= 0 && trace_px < plot_W && trace_py >= 0 &&
+          trace_py < plot_H) {
+        buff[cell(fb, trace_px, trace_py)] = 'O';
+        fb->col[cell(fb, trace_px, trace_py)] = 3;
+      }
+    }
+  }
+  // resolve the final colour and attributes, blanks have none
+  for (int i = 0; i < plot_W * plot_H; i++) {
+    char c = buff[i];
+    if (!fb->col[i] || c == '-' || c == '|' || c == '+')
+      fb->col[i] = 6;
+    if (c == ' ')
+      fb->col[i] = 0;
+    fb->attr[i] = c == 'O' || c == '*' ? pBOLD : 0;
+  }
+  return 0;
+}
+
+// the cells of src into dst, which keeps its own prev and layers
+int d_frame_copy(PFrame *dst, const PFrame *src) {
+  if (d_frame_reset(dst, src->w, src->h) != 0)
+    return -1;
+  memcpy(dst->glyph, src->glyph, (size_t)src->w * src->h * 3);
+  return 0;
+}
+
+int export_text(const char *f_name, const PFrame *fb) {
+  FILE *f = fopen(f_name, "w");
+  if (!f)
+    return -1;
+  for (int y = 0; y < fb->h; y++) {
+    fwrite(fb->glyph + (size_t)y * fb->w, 1, fb->w, f);
+    fputc('\n', f);
+  }
+  return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,20 @@
+// Created by Unium on 18.10.26
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "types.h"
+
+// frames
+int d_frame_reset(PFrame *fb, int w, int h);
+int d_frame_copy(PFrame *dst, const PFrame *src);
+void d_frame_free(PFrame *fb);
+void d_frame_forget(PFrame *fb);
+
+// the plot of a scene at any size, no terminal needed
+int d_render(PFrame *fb, PScene *s);
+
+// export, 0 when written
+int export_text(const char *f_name, const PFrame *fb);
+
+#endif // !RASTER_H
@@ -0,0 +1,166 @@
+// Created by Unium on 18.10.26
+
+// one thread draws the plot for the latest scene posted. it keeps its own
+// copy of the functions and compiles their formulas itself, so the ui can
+// go on editing them. the last finished frame waits for the ui to take
+// it, and one a newer post overtook after it was done is still shown
+// while the newer one is drawn. when full detail took long last time, a
+// scene is first drawn coarse and then refined pass by pass, each pass
+// shown as it is done, until full detail or until a newer post
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "maths.h"
+#include "raster.h"
+#include "render.h"
+#include "types.h"
+
+#define refinePasses 3 // the coarsest is pass refinePasses - 1
+#define refineMs 30    // full detail this slow starts the next one coarse
+
+static pthread_t thread;
+static int running, stopping;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static PScene want;                   // the latest post
+static _Atomic unsigned long posted;  // its generation
+static _Atomic unsigned long working; // the one being drawn, 0 when idle
+static unsigned long taken;           // the last one the thread picked up
+static PFrame done;                   // the last finished frame
+static PScene done_scene;
+static unsigned long finished, shown; // frames done, the last one taken
+
+// s without the compiled formulas, which belong to one thread
+static void bare(PScene *d, const PScene *s) {
+  *d = *s;
+  for (int i = 0; i < mmFuncs; i++)
+    d->funcs.functions[i].prog = d->funcs.functions[i].dprog = NULL;
+}
+
+// s takes over the scene p, keeping what it compiled for the formulas
+// that are still there
+static void adopt(PScene *s, const PScene *p) {
+  FLists old = s->funcs;
+  *s = *p;
+  for (int i = 0; i < s->funcs.count; i++) {
+    F *fn = &s->funcs.functions[i];
+    for (int j = 0; j < old.count; j++) {
+      F *o = &old.functions[j];
+      if (o->prog && strcmp(o->formula, fn->formula) == 0) {
+        fn->prog = o->prog;
+        fn->dprog = o->dprog;
+        o->prog = o->dprog = NULL;
+        break;
+      }
+    }
+  }
+  for (int j = 0; j < old.count; j++)
+    f_invalidate(&old.functions[j]);
+}
+
+static double now_ms(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void *render(void *p) {
+  (void)p;
+  PScene s = {0};
+  PFrame work = {0};
+  double full_ms = 0; // how long the last full detail pass took
+  pthread_mutex_lock(&lock);
+  while (!stopping) {
+    if (taken == posted) {
+      pthread_cond_wait(&wake, &lock);
+      continue;
+    }
+    unsigned long gen = taken = posted;
+    adopt(&s, &want);
+    atomic_store(&working, gen);
+    s.pass = full_ms > refineMs ? refinePasses - 1 : 0;
+    s.cancel = r_cancelled;
+    for (;;) {
+      pthread_mutex_unlock(&lock);
+      double t0 = now_ms();
+      // out of memory still counts as done, the frame is just blank
+      int ok = d_render(&work, &s) == 0 || !r_cancelled();
+      if (ok && s.pass == 0)
+        full_ms = now_ms() - t0;
+      pthread_mutex_lock(&lock);
+      if (!ok)
+        break;
+      d_frame_copy(&done, &work);
+      bare(&done_scene, &s);
+      finished++;
+      if (!s.more || s.pass == 0 || gen != posted)
+        break;
+      s.pass--;
+    }
+    atomic_store(&working, 0);
+  }
+  pthread_mutex_unlock(&lock);
+  for (int i = 0; i < s.funcs.count; i++)
+    f_invalidate(&s.funcs.functions[i]);
+  d_frame_free(&work);
+  return NULL;
+}
+
+void r_start(void) {
+  running = pthread_create(&thread, NULL, render, NULL) == 0;
+}
+
+void r_stop(void) {
+  if (!running)
+    return;
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  posted++; // cuts the frame in progress short
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+  pthread_join(thread, NULL);
+  running = stopping = 0;
+  d_frame_free(&done);
+}
+
+// draws s from now on, cancelling whatever frame is in progress
+void r_post(const PScene *s) {
+  pthread_mutex_lock(&lock);
+  bare(&want, s);
+  posted++;
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+}
+
+// the last finished frame into img and the scene it was drawn from into
+// s, 1 when the ui has not taken that one yet
+int r_take(PFrame *img, PScene *s) {
+  pthread_mutex_lock(&lock);
+  int fresh = finished != shown;
+  if (fresh) {
+    d_frame_copy(img, &done);
+    *s = done_scene;
+    shown = finished;
+  }
+  pthread_mutex_unlock(&lock);
+  return fresh;
+}
+
+// 1 while the latest post is being drawn or refined, or a frame of it is
+// not shown yet
+int r_pending(void) {
+  pthread_mutex_lock(&lock);
+  int p = taken != posted || atomic_load(&working) || finished != shown;
+  pthread_mutex_unlock(&lock);
+  return p;
+}
+
+// checked by the drawing between pieces of work, 1 once the frame being
+// drawn is no longer the latest post
+int r_cancelled(void) {
+  unsigned long w = atomic_load(&working);
+  return w && w != atomic_load(&posted);
+}
@@ -0,0 +1,19 @@
+// Created by Unium on 18.10.26
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "types.h"
+
+// the plot is drawn on a thread of its own. the ui posts a scene after
+// each batch of input and shows whichever frame was finished last. every
+// post bumps a generation, and work on an older one is cut short
+
+void r_start(void);
+void r_stop(void);
+void r_post(const PScene *s);
+int r_take(PFrame *img, PScene *s);
+int r_pending(void);
+int r_cancelled(void);
+
+#endif // !RENDER_H
@@ -0,0 +1,300 @@
+// Created by Unium on 18.10.26
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "types.h"
+
+static int is_num(const Prog *pg, int n, double v) {
+  return pg->nodes[n].op == oNUM && pg->nodes[n].v == v;
+}
+
+static int is_op(const Prog *pg, int n, Op op) {
+  return n >= 0 && pg->nodes[n].op == op;
+}
+
+// finite for every finite x (overflow aside), so 0*n can become 0
+static int total(const Prog *pg, int n) {
+  const CNode *nd = &pg->nodes[n];
+  switch (nd->op) {
+  case oNUM:
+    return isfinite(nd->v);
+  case oX:
+    return 1;
+  case oADD:
+  case oSUB:
+  case oMUL:
+    return total(pg, nd->a) && total(pg, nd->b);
+  case oNEG:
+  case oPOWI:
+  case oSIN:
+  case oCOS:
+  case oATAN:
+  case oTANH:
+  case oABS:
+  case oFLOOR:
+  case oCEIL:
+    return total(pg, nd->a);
+  default:
+    return 0;
+  }
+}
+
+// nothing below n can poison the sample, so n^0 and 1^n can become 1 the
+// same way pow(nan, 0) is 1
+static int safe(const Prog *pg, int n) {
+  const CNode *nd = &pg->nodes[n];
+  if (nd->op == oDIV || nd->op == oMOD || nd->op == oFACT)
+    return 0;
+  return (nd->a < 0 || safe(pg, nd->a)) && (nd->b < 0 || safe(pg, nd->b));
+}
+
+int p_fold(Prog *pg, Op op, int a, int b, double v) {
+  if (a >= 0 && pg->nodes[a].op == oNUM &&
+      (b < 0 || pg->nodes[b].op == oNUM)) {
+    int e = 0;
+    double r = p_op(op, pg->nodes[a].v, b >= 0 ? pg->nodes[b].v : v, &e);
+    if (!e && isfinite(r))
+      return p_node(pg, oNUM, -1, -1, r);
+  }
+
+  switch (op) {
+  case oADD:
+    if (is_num(pg, b, 0))
+      return a;
+    if (is_num(pg, a, 0))
+      return b;
+    if (is_op(pg, b, oNEG))
+      return p_fold(pg, oSUB, a, pg->nodes[b].a, 0);
+    if (is_op(pg, a, oNEG))
+      return p_fold(pg, oSUB, b, pg->nodes[a].a, 0);
+    break;
+  case oSUB:
+    if (is_num(pg, b, 0))
+      return a;
+    if (is_num(pg, a, 0))
+      return p_fold(pg, oNEG, b, -1, 0);
+    if (is_op(pg, b, oNEG))
+      return p_fold(pg, oADD, a, pg->nodes[b].a, 0);
+    break;
+  case oMUL:
+    if (is_num(pg, b, 1))
+      return a;
+    if (is_num(pg, a, 1))
+      return b;
+    if (is_num(pg, b, -1))
+      return p_fold(pg, oNEG, a, -1, 0);
+    if (is_num(pg, a, -1))
+      return p_fold(pg, oNEG, b, -1, 0);
+    if ((is_num(pg, a, 0) && total(pg, b)) ||
+        (is_num(pg, b, 0) && total(pg, a)))
+      return p_node(pg, oNUM, -1, -1, 0);
+    if (is_op(pg, a, oNEG) && is_op(pg, b, oNEG))
+      return p_fold(pg, oMUL, pg->nodes[a].a, pg->nodes[b].a, 0);
+    break;
+  case oDIV:
+    if (is_num(pg, b, 1))
+      return a;
+    if (is_num(pg, b, -1))
+      return p_fold(pg, oNEG, a, -1, 0);
+    break;
+  case oPOW:
+    if (is_num(pg, b, 1))
+      return a;
+    if ((is_num(pg, b, 0) && safe(pg, a)) || (is_num(pg, a, 1) && safe(pg, b)))
+      return p_node(pg, oNUM, -1, -1, 1);
+    // small integer powers become multiplies instead of a pow() call
+    if (pg->nodes[b].op == oNUM) {
+      double n = pg->nodes[b].v;
+      if (n >= 2 && n <= 16 && n == floor(n))
+        return p_node(pg, oPOWI, a, -1, n);
+    }
+    break;
+  case oNEG:
+    if (is_op(pg, a, oNEG))
+      return pg->nodes[a].a;
+    break;
+  default:
+    break;
+  }
+  return p_node(pg, op, a, b, v);
+}
+
+static void mark(const Prog *pg, int n, char *live) {
+  if (live[n])
+    return;
+  live[n] = 1;
+  if (pg->nodes[n].a >= 0)
+    mark(pg, pg->nodes[n].a, live);
+  if (pg->nodes[n].b >= 0)
+    mark(pg, pg->nodes[n].b, live);
+}
+
+// drops nodes the root no longer reaches, keeping children before parents
+static void compact(Prog *pg) {
+  char *live = calloc(pg->n_nodes, 1);
+  int *map = malloc(pg->n_nodes * sizeof(int));
+  if (!live || !map) {
+    free(live);
+    free(map);
+    return;
+  }
+  mark(pg, pg->root, live);
+  int k = 0;
+  for (int i = 0; i < pg->n_nodes; i++) {
+    if (!live[i])
+      continue;
+    CNode nd = pg->nodes[i];
+    nd.a = nd.a >= 0 ? map[nd.a] : -1;
+    nd.b = nd.b >= 0 ? map[nd.b] : -1;
+    map[i] = k;
+    pg->nodes[k++] = nd;
+  }
+  pg->root = map[pg->root];
+  pg->n_nodes = k;
+  free(live);
+  free(map);
+}
+
+void p_optimize(Prog *pg) {
+  if (pg->root < 0)
+    return;
+  Prog out = {0};
+  int *map = malloc(pg->n_nodes * sizeof(int));
+  if (!map)
+    return;
+  for (int i = 0; i < pg->n_nodes; i++) {
+    CNode nd = pg->nodes[i];
+    map[i] = p_fold(&out, nd.op, nd.a >= 0 ? map[nd.a] : -1,
+                    nd.b >= 0 ? map[nd.b] : -1, nd.v);
+    if (map[i] < 0) {
+      free(out.nodes);
+      free(map);
+      return;
+    }
+  }
+  free(pg->nodes);
+  pg->nodes = out.nodes;
+  pg->n_nodes = out.n_nodes;
+  pg->cap = out.cap;
+  pg->root = map[pg->root];
+  free(map);
+  compact(pg);
+}
+
+typedef struct {
+  char *s;
+  int n, len;
+} Out;
+
+static void put(Out *o, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int room = o->len < o->n ? o->n - o->len : 0;
+  o->len += vsnprintf(o->s + (room ? o->len : 0), room, fmt, ap);
+  va_end(ap);
+}
+
+// binding strength as the grammar sees it. a function call swallows a whole
+// unary expression, so sin(x)^2 has to be printed as (sin(x))^2
+static int prec(const CNode *nd) {
+  switch (nd->op) {
+  case oADD:
+  case oSUB:
+    return 1;
+  case oMUL:
+  case oDIV:
+  case oMOD:
+    return 2;
+  case oPOW:
+  case oPOWI:
+    return 4;
+  case oFACT:
+    return 5;
+  case oNUM:
+    return nd->v < 0 ? 3 : 6;
+  case oX:
+    return 6;
+  default:
+    return 3;
+  }
+}
+
+static void fmt(const Prog *pg, int n, int need, Out *o) {
+  const CNode *nd = &pg->nodes[n];
+  int paren = prec(nd) < need;
+  if (paren)
+    put(o, "(");
+  switch (nd->op) {
+  case oNUM:
+    if (nd->v == M_PI)
+      put(o, "pi");
+    else if (nd->v == M_E)
+      put(o, "e");
+    else {
+      // shortest of the two that reads back to the same double
+      char t[32];
+      snprintf(t, sizeof t, "%.15g", nd->v);
+      if (strtod(t, NULL) != nd->v)
+        snprintf(t, sizeof t, "%.17g", nd->v);
+      put(o, "%s", t);
+    }
+    break;
+  case oX:
+    put(o, "x");
+    break;
+  case oADD:
+  case oSUB:
+    fmt(pg, nd->a, 1, o);
+    put(o, nd->op == oADD ? " + " : " - ");
+    fmt(pg, nd->b, 2, o);
+    break;
+  case oMUL:
+  case oDIV:
+  case oMOD:
+    fmt(pg, nd->a, 2, o);
+    put(o, nd->op == oMUL ? "*" : nd->op == oDIV ? "/" : "%%");
+    fmt(pg, nd->b, 3, o);
+    break;
+  case oNEG:
+    put(o, "-");
+    fmt(pg, nd->a, 3, o);
+    break;
+  case oPOW:
+    fmt(pg, nd->a, 5, o);
+    put(o, "^");
+    fmt(pg, nd->b, 4, o);
+    break;
+  case oPOWI:
+    fmt(pg, nd->a, 5, o);
+    put(o, "^%d", (int)nd->v);
+    break;
+  case oFACT:
+    fmt(pg, nd->a, 5, o);
+    put(o, "!");
+    break;
+  default:
+    put(o, "%s(", p_fn(nd->op)->def.c);
+    fmt(pg, nd->a, 0, o);
+    put(o, ")");
+    break;
+  }
+  if (paren)
+    put(o, ")");
+}
+
+// prints the (simplified) tree back as a formula the parser reads the same
+// way (up to the rounding of long constants), returns the full length like
+// snprintf
+int p_format(const Prog *pg, char *buf, int n) {
+  Out o = {buf, n, 0};
+  if (n > 0)
+    buf[0] = '\0';
+  if (!pg || pg->root < 0)
+    return 0;
+  fmt(pg, pg->root, 0, &o);
+  return o.len;
+}
@@ -1,4 +0,0 @@
-// Created by Unium on 06.02.26
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
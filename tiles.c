@@ -0,0 +1,280 @@
+// Created by Unium on 18.10.26
+
+// cache of point samples, kept across frames so zooming back or panning
+// over columns seen before doesn't evaluate them again. a finite x != 0 is
+// exactly m * 2^l for one odd m, and the samples of a program sit in tiles
+// of tSize neighbouring odd m at the same l. the sampler works on a dyadic
+// grid that it halves, so its points at one zoom are the same doubles at
+// the next and neighbouring points share tiles. tiles are dropped least
+// recently used first once the cache outgrows its budget. programs are
+// told apart by their whole code, kept once for all of their tiles, so a
+// hash collision never hands one the samples of another. the pool's
+// workers share it, one lock covers the lookups and one the stores of a
+// call, the evaluations in between run unlocked
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maths.h"
+#include "parser.h"
+#include "types.h"
+
+#define tSize 64          // samples per tile
+#define tBuckets 16384    // power of two
+#define tBudget (8 << 20) // default bytes of tiles
+
+// the code of a program with cached samples, shared by its tiles
+typedef struct Code {
+  uint64_t hash; // code_hash of it
+  int len, tiles;
+  CInstr *code;
+  struct Code *next;
+} Code;
+
+typedef struct Tile {
+  Code *prog;
+  int level;
+  int64_t index;
+  uint64_t have; // which of v are set
+  double v[tSize];
+  struct Tile *next;          // in the bucket
+  struct Tile *newer, *older; // in the lru list
+} Tile;
+
+static Tile *buckets[tBuckets];
+static Tile *newest, *oldest;
+static Code *codes;
+static size_t used, budget = tBudget;
+static long hits, misses;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the code of a program, all its values depend on
+static uint64_t code_hash(const Prog *pg) {
+  uint64_t h = 14695981039346656037ull;
+  for (int i = 0; i < pg->len; i++) {
+    uint64_t w[2] = {(uint64_t)pg->code[i].op, 0};
+    memcpy(&w[1], &pg->code[i].v, sizeof(double));
+    for (int k = 0; k < 2; k++)
+      h = (h ^ w[k]) * 1099511628211ull;
+  }
+  return h;
+}
+
+static int same_code(const Code *c, const Prog *pg) {
+  if (c->len != pg->len)
+    return 0;
+  for (int i = 0; i < c->len; i++)
+    if (c->code[i].op != pg->code[i].op ||
+        memcmp(&c->code[i].v, &pg->code[i].v, sizeof(double)))
+      return 0;
+  return 1;
+}
+
+// the code of pg among those with tiles. a new one when make is set, NULL
+// when there is none (or no memory for it)
+static Code *find_code(const Prog *pg, uint64_t h, int make) {
+  for (Code *c = codes; c; c = c->next)
+    if (c->hash == h && same_code(c, pg))
+      return c;
+  if (!make)
+    return NULL;
+  Code *c = malloc(sizeof(Code));
+  CInstr *code = malloc((pg->len ? pg->len : 1) * sizeof(CInstr));
+  if (!c || !code) {
+    free(c);
+    free(code);
+    return NULL;
+  }
+  memcpy(code, pg->code, pg->len * sizeof(CInstr));
+  *c = (Code){h, pg->len, 0, code, codes};
+  codes = c;
+  return c;
+}
+
+static void drop_code(Code *c) {
+  Code **p = &codes;
+  while (*p != c)
+    p = &(*p)->next;
+  *p = c->next;
+  free(c->code);
+  free(c);
+}
+
+// x as the tile and slot it is cached at, 0 for non-finite x. the two
+// zeros get levels of their own
+static int split(double x, int *level, int64_t *index, int *slot) {
+  if (!isfinite(x))
+    return 0;
+  if (x == 0) {
+    *level = INT_MIN + !!signbit(x);
+    *index = *slot = 0;
+    return 1;
+  }
+  int e;
+  int64_t m = (int64_t)ldexp(frexp(x, &e), 53);
+  int tz = __builtin_ctzll((uint64_t)m);
+  m >>= tz;
+  *level = e - 53 + tz;
+  // odd m = 2j + 1
+  int64_t j = (m - 1) / 2;
+  *index = j >= 0 ? j / tSize : -((-j - 1) / tSize) - 1;
+  *slot = (int)(j - *index * tSize);
+  return 1;
+}
+
+static size_t bucket(const Code *prog, int level, int64_t index) {
+  uint64_t h = prog->hash ^ ((uint64_t)level * 0x9e3779b97f4a7c15ull) ^
+               ((uint64_t)index * 0xc2b2ae3d27d4eb4full);
+  return (h ^ h >> 29) & (tBuckets - 1);
+}
+
+static void unlink_lru(Tile *t) {
+  if (t->newer)
+    t->newer->older = t->older;
+  else
+    newest = t->older;
+  if (t->older)
+    t->older->newer = t->newer;
+  else
+    oldest = t->newer;
+}
+
+static void push_lru(Tile *t) {
+  t->newer = NULL;
+  t->older = newest;
+  if (newest)
+    newest->newer = t;
+  newest = t;
+  if (!oldest)
+    oldest = t;
+}
+
+static void drop(Tile *t) {
+  Tile **p = &buckets[bucket(t->prog, t->level, t->index)];
+  while (*p != t)
+    p = &(*p)->next;
+  *p = t->next;
+  unlink_lru(t);
+  used -= sizeof(Tile);
+  if (!--t->prog->tiles)
+    drop_code(t->prog);
+  free(t);
+}
+
+// the tile, made most recently used. a new one when make is set, NULL
+// when there is none (or no memory for it)
+static Tile *find(Code *prog, int level, int64_t index, int make) {
+  Tile **b = &buckets[bucket(prog, level, index)];
+  for (Tile *t = *b; t; t = t->next) {
+    if (t->prog == prog && t->level == level && t->index == index) {
+      unlink_lru(t);
+      push_lru(t);
+      return t;
+    }
+  }
+  if (!make)
+    return NULL;
+  while (oldest && used + sizeof(Tile) > budget)
+    drop(oldest);
+  Tile *t = malloc(sizeof(Tile));
+  if (!t)
+    return NULL;
+  *t = (Tile){prog, level, index, 0, {0}, *b, NULL, NULL};
+  prog->tiles++;
+  *b = t;
+  push_lru(t);
+  used += sizeof(Tile);
+  return t;
+}
+
+// f at xs into ys as p_batch gives it, with the samples already cached
+// served from the cache. the rest are evaluated in one batch and kept.
+// returns how many had to be evaluated
+int f_samples(const Prog *f, const double *xs, double *ys, int n) {
+  if (!f || n <= 0) {
+    p_batch(f, xs, ys, n);
+    return n > 0 ? n : 0;
+  }
+  uint64_t id = code_hash(f);
+  int *miss = malloc(n * sizeof(int));
+  double *mx = malloc(n * sizeof(double)), *my = malloc(n * sizeof(double));
+  if (!miss || !mx || !my) {
+    free(miss);
+    free(mx);
+    free(my);
+    p_batch(f, xs, ys, n);
+    return n;
+  }
+
+  int k = 0;
+  pthread_mutex_lock(&lock);
+  Code *c = find_code(f, id, 0);
+  for (int i = 0; i < n; i++) {
+    int level, slot;
+    int64_t index;
+    Tile *t = c && split(xs[i], &level, &index, &slot)
+                  ? find(c, level, index, 0)
+                  : NULL;
+    if (t && (t->have >> slot & 1)) {
+      ys[i] = t->v[slot];
+      continue;
+    }
+    miss[k] = i;
+    mx[k++] = xs[i];
+  }
+  hits += n - k;
+  misses += k;
+  pthread_mutex_unlock(&lock);
+
+  p_batch(f, mx, my, k);
+  pthread_mutex_lock(&lock);
+  // held while storing, so making room never frees it
+  if ((c = find_code(f, id, 1)))
+    c->tiles++;
+  for (int i = 0; i < k; i++) {
+    ys[miss[i]] = my[i];
+    int level, slot;
+    int64_t index;
+    Tile *t = c && split(mx[i], &level, &index, &slot)
+                  ? find(c, level, index, 1)
+                  : NULL;
+    if (t) {
+      t->v[slot] = my[i];
+      t->have |= (uint64_t)1 << slot;
+    }
+  }
+  if (c && !--c->tiles)
+    drop_code(c);
+  pthread_mutex_unlock(&lock);
+  free(miss);
+  free(mx);
+  free(my);
+  return k;
+}
+
+void f_cache_budget(size_t bytes) {
+  pthread_mutex_lock(&lock);
+  budget = bytes;
+  while (oldest && used > budget)
+    drop(oldest);
+  pthread_mutex_unlock(&lock);
+}
+
+void f_cache_stats(long *h, long *m, size_t *bytes) {
+  pthread_mutex_lock(&lock);
+  *h = hits;
+  *m = misses;
+  *bytes = used;
+  pthread_mutex_unlock(&lock);
+}
+
+void f_cache_clear(void) {
+  pthread_mutex_lock(&lock);
+  while (oldest)
+    drop(oldest);
+  pthread_mutex_unlock(&lock);
+}
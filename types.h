@@ -3,15 +3,22 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stddef.h>
+
 #define mmHistory 20
 #define mmFormulaLen 256
 #define mmFuncs 10
 #define sidebarWidth 38
-#define cmdCount 9
+#define cmdCount 12
 
 // H History
 // F Function
 // P Plot
+// C Compiled formula
+// B Builtin function or constant
+// D Dual number
+// I Interval
+// S Curve sample
 
 typedef struct {
   char formula[mmFormulaLen];
@@ -24,10 +31,84 @@ typedef struct {
   int sel;
 } H;
 
+typedef enum {
+  oNUM,
+  oX,
+  oNEG,
+  oFACT,
+  oPOWI, // a^v for a small integer v
+  oADD,
+  oSUB,
+  oMUL,
+  oDIV,
+  oMOD,
+  oPOW,
+  oASIN,
+  oACOS,
+  oATAN,
+  oSINH,
+  oCOSH,
+  oTANH,
+  oSIN,
+  oCOS,
+  oTAN,
+  oEXP,
+  oSQRT,
+  oLN,
+  oLOG,
+  oABS,
+  oFLOOR,
+  oCEIL,
+  oCOUNT
+} Op;
+
+// tree node, children always sit before their parent in Prog.nodes
+typedef struct {
+  Op op;
+  int a, b;
+  double v;
+} CNode;
+
+// postfix instruction
+typedef struct {
+  Op op;
+  double v;
+} CInstr;
+
+typedef struct {
+  CNode *nodes;
+  int n_nodes, cap;
+  int root;
+  CInstr *code;
+  int len;
+  int depth;
+  void *jit; // native code from p_jit, NULL when interpreted
+  size_t jit_len;
+} Prog;
+
+// value with its first and second derivative in x
+typedef struct {
+  double v, d, dd;
+} Dual;
+
+// closed range of values, empty when lo > hi
+typedef struct {
+  double lo, hi;
+} Ival;
+
+// point on a plotted curve, brk when it must not be joined to the next one
+typedef struct {
+  double x, y;
+  int brk;
+} SPoint;
+
 typedef struct {
   char formula[mmFormulaLen];
   int col;
   int active;
+  Prog *prog;  // cached p_compile(formula), NULL when stale
+  Prog *dprog; // cached p_deriv(prog), NULL when stale
+  int evals;   // evaluations the last update of its curve took
 } F;
 
 typedef struct {
@@ -43,18 +124,63 @@ typedef struct {
   int selStart;
 } IntegrationState;
 
+// retained framebuffer for the inside of a window, one cell per character
+// with row 0 at the top. glyph, col and attr are one allocation of w * h
+// cells each, followed by a copy of them as last drawn (prev). kept across
+// frames and only reallocated when the window resizes
+typedef struct {
+  int w, h;
+  char *glyph;
+  unsigned char *col;  // colour pair, 0 for none
+  unsigned char *attr; // pBOLD, pREVERSE
+  unsigned char *prev;
+  int valid;              // the window still shows prev
+  struct PLayers *layers; // cached layers of the plot, see graph.c
+} PFrame;
+
+#define pBOLD 1
+#define pREVERSE 2
+
 typedef struct {
   double mX, mmX;
   double mY, mmY;
   int autoScale;
+  int envelope; // draw interval enclosures per column instead of samples
 } PView;
 
+// what a frame of the plot is drawn from. drawing it fills in trace_Y,
+// more and the evals of funcs
+typedef struct {
+  FLists funcs;
+  PView v;
+  IntegrationState integ;
+  int w, h; // cells of the plot area
+  int trace_mode, show_deriv;
+  double trace_X, trace_slope;
+  int pass;            // of the refinement, 0 for full detail
+  int (*cancel)(void); // checked between pieces of work, may be NULL
+  double trace_Y;
+  int more; // some curves were left coarser than full detail
+} PScene;
+
 typedef struct {
   const char *c;
   const char *s;
   const char *d;
 } CDef;
 
+// argument range of a builtin, outside it the result is NaN
+typedef enum { dALL, dUNIT, dNONNEG, dPOS } Dom;
+
+typedef struct {
+  CDef def;    // name, usage and description for completion and :help
+  Op op;       // oNUM for constants
+  int arity;   // 0 for constants, 1 for functions
+  double v;    // value of a constant
+  Dom dom;
+  double (*fn)(double); // scalar implementation, the kernels dispatch on op
+} Builtin;
+
 typedef enum { mNORMAL, mINSERT, mCOMMAND, mTRACE, mINTEGRATE, mHELP } Mode;
 
 #endif // !TYPES_H
@@ -0,0 +1,443 @@
+// Created by Unium on 18.10.26
+
+// the plot as vector graphics, svg or pdf. the curves are sampled at the
+// size of the page like an image of it would be, then every unbroken run
+// of points is cut to the page and thinned douglas-peucker style: a point
+// stays only when leaving it out would move the line past it by more than
+// the tolerance. however many points the sampler took, a smooth stretch
+// keeps a few. svg has the points in graph coordinates under one
+// transform, pdf in points on the page
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "image.h"
+#include "maths.h"
+#include "parser.h"
+#include "pool.h"
+#include "types.h"
+#include "vector.h"
+
+#define vecBudget 8 // evaluations per unit of width and curve
+
+static double tolerance = 0.25; // in units of the page
+
+// points on the page (y down) in runs, each joined one to the next
+typedef struct {
+  SPoint *pts;
+  int *run; // where each run starts, run[nruns] is the end
+  int nruns;
+  int col;
+} VPath;
+
+typedef struct {
+  const PView *v;
+  int w, h;
+  double m; // how far past the page lines are kept
+  const Prog *prog[mmFuncs];
+  VPath c[mmFuncs];
+  int nc;
+  VPath fill; // one closed run per stretch where f is defined
+} VJob;
+
+// douglas-peucker over p[0..n), the ends always stay. the points kept are
+// moved to the front, returns how many
+static int thin(SPoint *p, int n, int *stack, unsigned char *keep) {
+  if (n < 3 || tolerance <= 0)
+    return n;
+  memset(keep, 0, n);
+  keep[0] = keep[n - 1] = 1;
+  int sp = 0;
+  stack[sp++] = 0;
+  stack[sp++] = n - 1;
+  while (sp) {
+    int b = stack[--sp], a = stack[--sp], far = -1;
+    double d = tolerance;
+    for (int i = a + 1; i < b; i++) {
+      double e = d_seg_dist(p[i].x, p[i].y, p[a].x, p[a].y, p[b].x, p[b].y);
+      if (e > d) {
+        d = e;
+        far = i;
+      }
+    }
+    if (far < 0)
+      continue;
+    keep[far] = 1;
+    stack[sp++] = a;
+    stack[sp++] = far;
+    stack[sp++] = far;
+    stack[sp++] = b;
+  }
+  int k = 0;
+  for (int i = 0; i < n; i++)
+    if (keep[i])
+      p[k++] = p[i];
+  return k;
+}
+
+// ends the run of o that started at from, thinned
+static void close_run(VPath *o, int *n, int from, int *stack,
+                      unsigned char *keep) {
+  if (*n == from)
+    return;
+  *n = from + thin(o->pts + from, *n - from, stack, keep);
+  o->run[++o->nruns] = *n;
+}
+
+// the page coordinates p[0..n) as runs into o: broken where the sampler
+// broke the curve or f is undefined, and where it leaves the page
+static int trace(VPath *o, const SPoint *p, int n, const VJob *j) {
+  // a line adds at most two points, and each run has a point of its own
+  o->pts = malloc((2 * n + 1) * sizeof(SPoint));
+  o->run = malloc((n + 2) * sizeof(int));
+  int *stack = malloc((4 * n + 4) * sizeof(int));
+  unsigned char *keep = malloc(2 * n + 1);
+  if (!o->pts || !o->run || !stack || !keep) {
+    free(stack);
+    free(keep);
+    return -1;
+  }
+  o->nruns = 0;
+  o->run[0] = 0;
+  int k = 0, from = 0;
+  double x0 = -j->m, y0 = -j->m, x1 = j->w + j->m, y1 = j->h + j->m;
+  for (int i = 0; i < n; i++) {
+    if (!isfinite(p[i].y))
+      continue;
+    int next = i + 1 < n && !p[i].brk && isfinite(p[i + 1].y);
+    int prev = i > 0 && !p[i - 1].brk && isfinite(p[i - 1].y);
+    if (!next) {
+      // the end of a run, or a dot if it is joined to neither side
+      if (!prev && p[i].x >= x0 && p[i].x <= x1 && p[i].y >= y0 &&
+          p[i].y <= y1)
+        o->pts[k++] = (SPoint){p[i].x, p[i].y, 0};
+      close_run(o, &k, from, stack, keep);
+      from = k;
+      continue;
+    }
+    double ax = p[i].x, ay = p[i].y, bx = p[i + 1].x, by = p[i + 1].y;
+    if (!d_clip(&ax, &ay, &bx, &by, x0, y0, x1, y1)) {
+      close_run(o, &k, from, stack, keep);
+      from = k;
+      continue;
+    }
+    // coming back onto the page starts a new run
+    if (k == from || ax != p[i].x || ay != p[i].y) {
+      close_run(o, &k, from, stack, keep);
+      from = k;
+      o->pts[k++] = (SPoint){ax, ay, 0};
+    }
+    o->pts[k++] = (SPoint){bx, by, 0};
+    if (bx != p[i + 1].x || by != p[i + 1].y) {
+      close_run(o, &k, from, stack, keep);
+      from = k;
+    }
+  }
+  close_run(o, &k, from, stack, keep);
+  free(stack);
+  free(keep);
+  return 0;
+}
+
+static void path_task(void *arg, int i) {
+  VJob *j = arg;
+  const PView *v = j->v;
+  SPoint *p;
+  int evals = 0;
+  int n = sample_curve(j->prog[i], v, j->w, j->h, j->w * vecBudget, &p,
+                       &evals);
+  double sx = j->w / (v->mmX - v->mX), sy = j->h / (v->mmY - v->mY);
+  for (int k = 0; k < n; k++) {
+    p[k].x = (p[k].x - v->mX) * sx;
+    p[k].y = (v->mmY - p[k].y) * sy;
+  }
+  if (n > 0 && trace(&j->c[i], p, n, j) != 0) {
+    free(j->c[i].pts);
+    free(j->c[i].run);
+    j->c[i] = (VPath){.col = j->c[i].col};
+  }
+  free(p);
+}
+
+// the integration fill, f over [a, b] at the middle of every unit of the
+// page down to y = 0. every stretch where f is defined is closed along
+// the axis
+static void fill_path(VJob *j, const PScene *s) {
+  const PView *v = j->v;
+  const F *sel = &s->funcs.functions[s->funcs.sel];
+  double sx = j->w / (v->mmX - v->mX), sy = j->h / (v->mmY - v->mY);
+  double a = (fmin(s->integ.a, s->integ.b) - v->mX) * sx;
+  double b = (fmax(s->integ.a, s->integ.b) - v->mX) * sx;
+  int x0 = (int)fmax(0, ceil(a - 0.5));
+  int x1 = (int)fmin(j->w - 1, floor(b - 0.5));
+  int n = x1 - x0 + 1;
+  if (n <= 0 || !sel->prog)
+    return;
+  double *xs = malloc(n * sizeof(double)), *ys = malloc(n * sizeof(double));
+  // a run of n points and its two ends on the axis, per point at most
+  VPath *o = &j->fill;
+  o->pts = malloc(3 * n * sizeof(SPoint));
+  o->run = malloc((n + 1) * sizeof(int));
+  int *stack = malloc((2 * n + 4) * sizeof(int));
+  unsigned char *keep = malloc(n);
+  if (xs && ys && o->pts && o->run && stack && keep) {
+    for (int i = 0; i < n; i++)
+      xs[i] = v->mX + (x0 + i + 0.5) / sx;
+    p_batch(sel->prog, xs, ys, n);
+    double zero = v->mmY * sy;
+    o->run[0] = 0;
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+      if (!isfinite(ys[i]))
+        continue;
+      int start = i;
+      while (i < n && isfinite(ys[i]))
+        i++;
+      int from = k;
+      o->pts[k++] = (SPoint){x0 + start + 0.5, zero, 0};
+      for (int q = start; q < i; q++) {
+        double y = fmax(-j->m, fmin(j->h + j->m, (v->mmY - ys[q]) * sy));
+        o->pts[k++] = (SPoint){x0 + q + 0.5, y, 0};
+      }
+      k = from + 1 + thin(o->pts + from + 1, i - start, stack, keep);
+      o->pts[k++] = (SPoint){x0 + i - 0.5, zero, 0};
+      o->run[++o->nruns] = k;
+    }
+    o->col = sel->col & 7;
+  } else {
+    free(o->pts);
+    free(o->run);
+    *o = (VPath){0};
+  }
+  free(xs);
+  free(ys);
+  free(stack);
+  free(keep);
+}
+
+// samples and traces everything s shows on a w x h page
+static void build(VJob *j, const PScene *s, int w, int h) {
+  const FLists *funcs = &s->funcs;
+  *j = (VJob){.v = &s->v, .w = w, .h = h, .m = d_line_width(h) + 1};
+  for (int f = 0; f < funcs->count; f++) {
+    const F *fn = &funcs->functions[f];
+    if (fn->active && fn->prog) {
+      j->prog[j->nc] = fn->prog;
+      j->c[j->nc++].col = fn->col & 7;
+    }
+  }
+  t_for(j->nc, path_task, j);
+  if (s->integ.active && funcs->count)
+    fill_path(j, s);
+}
+
+static void unbuild(VJob *j) {
+  for (int f = 0; f < j->nc; f++) {
+    free(j->c[f].pts);
+    free(j->c[f].run);
+  }
+  free(j->fill.pts);
+  free(j->fill.run);
+}
+
+// significant digits that tell apart values a hundredth of a unit of the
+// page apart, anywhere in [lo, hi] with per graph units to a page unit
+static int digits(double lo, double hi, double per) {
+  double big = fmax(fabs(lo), fabs(hi)), step = per / 100;
+  int d = big > 0 && step > 0 ? (int)ceil(log10(big / step)) + 1 : 6;
+  return d < 6 ? 6 : d > 17 ? 17 : d;
+}
+
+static void svg_rgb(FILE *f, const unsigned char *c) {
+  fprintf(f, "#%02x%02x%02x", c[0], c[1], c[2]);
+}
+
+int d_vector_tolerance(double t) {
+  if (!(t >= 0))
+    return -1;
+  tolerance = t;
+  return 0;
+}
+
+int export_svg(const char *f_name, const PScene *s, int w, int h) {
+  if (w <= 0 || h <= 0)
+    return -1;
+  FILE *f = fopen(f_name, "w");
+  if (!f)
+    return -1;
+  VJob j;
+  build(&j, s, w, h);
+  const PView *v = &s->v;
+  double px = (v->mmX - v->mX) / w, py = (v->mmY - v->mY) / h;
+  int dx = digits(v->mX, v->mmX, px), dy = digits(v->mY, v->mmY, py);
+
+  fprintf(f,
+          "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+          "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" "
+          "height=\"%d\" viewBox=\"0 0 %d %d\">\n"
+          "<defs><clipPath id=\"view\"><rect width=\"%d\" height=\"%d\"/>"
+          "</clipPath></defs>\n"
+          "<rect width=\"%d\" height=\"%d\" fill=\"",
+          w, h, w, h, w, h, w, h);
+  svg_rgb(f, d_palette[0]);
+  // graph coordinates onto the page, lines stay as wide as on the page
+  fprintf(f,
+          "\"/>\n<g clip-path=\"url(#view)\">\n"
+          "<g transform=\"matrix(%.17g 0 0 %.17g %.17g %.17g)\" "
+          "fill=\"none\" stroke-linecap=\"round\" "
+          "stroke-linejoin=\"round\">\n",
+          1 / px, -1 / py, -v->mX / px, v->mmY / py);
+
+  int x_axis = v->mY <= 0 && v->mmY >= 0, y_axis = v->mX <= 0 && v->mmX >= 0;
+  if (x_axis || y_axis) {
+    fprintf(f, "<path d=\"");
+    if (x_axis)
+      fprintf(f, "M%.*g 0H%.*g", dx, v->mX, dx, v->mmX);
+    if (y_axis)
+      fprintf(f, "M0 %.*gV%.*g", dy, v->mY, dy, v->mmY);
+    fprintf(f, "\" stroke=\"");
+    svg_rgb(f, d_axis_rgb);
+    fprintf(f, "\" stroke-width=\"1\" "
+               "vector-effect=\"non-scaling-stroke\"/>\n");
+  }
+
+  VPath *o = &j.fill;
+  for (int r = 0; r < o->nruns; r++) {
+    fprintf(f, "<path d=\"M");
+    for (int k = o->run[r]; k < o->run[r + 1]; k++)
+      fprintf(f, "%s%.*g,%.*g", k > o->run[r] ? " " : "", dx,
+              v->mX + o->pts[k].x * px, dy, v->mmY - o->pts[k].y * py);
+    fprintf(f, "Z\" fill=\"");
+    svg_rgb(f, d_palette[o->col]);
+    fprintf(f, "\" fill-opacity=\"%g\" stroke=\"none\"/>\n", fillAlpha);
+  }
+
+  for (int c = 0; c < j.nc; c++) {
+    o = &j.c[c];
+    fprintf(f, "<g stroke=\"");
+    svg_rgb(f, d_palette[o->col]);
+    fprintf(f,
+            "\" stroke-width=\"%g\" "
+            "vector-effect=\"non-scaling-stroke\">\n",
+            d_line_width(h));
+    for (int r = 0; r < o->nruns; r++) {
+      // a dot is a line of no length, which round caps still draw
+      int a = o->run[r], b = o->run[r + 1], dot = b - a == 1;
+      fprintf(f, "<polyline points=\"");
+      for (int k = a; k < b + dot; k++) {
+        const SPoint *q = &o->pts[k < b ? k : a];
+        fprintf(f, "%s%.*g,%.*g", k > a ? " " : "", dx, v->mX + q->x * px,
+                dy, v->mmY - q->y * py);
+      }
+      fprintf(f, "\"/>\n");
+    }
+    fprintf(f, "</g>\n");
+  }
+  fprintf(f, "</g>\n</g>\n</svg>\n");
+  unbuild(&j);
+  return ferror(f) | fclose(f) ? -1 : 0;
+}
+
+static void pdf_rgb(FILE *f, const unsigned char *c, const char *op) {
+  fprintf(f, "%.3f %.3f %.3f %s\n", c[0] / 255.0, c[1] / 255.0,
+          c[2] / 255.0, op);
+}
+
+// the drawing of the page, y up from the bottom as pdf has it
+static void pdf_content(FILE *f, const VJob *j) {
+  const PView *v = j->v;
+  int w = j->w, h = j->h;
+  double sx = w / (v->mmX - v->mX), sy = h / (v->mmY - v->mY);
+  pdf_rgb(f, d_palette[0], "rg");
+  fprintf(f, "0 0 %d %d re f\n0 0 %d %d re W n\n1 J 1 j\n", w, h, w, h);
+  pdf_rgb(f, d_axis_rgb, "RG");
+  fprintf(f, "1 w\n");
+  if (v->mY <= 0 && v->mmY >= 0)
+    fprintf(f, "0 %.3f m %d %.3f l S\n", -v->mY * sy, w, -v->mY * sy);
+  if (v->mX <= 0 && v->mmX >= 0)
+    fprintf(f, "%.3f 0 m %.3f %d l S\n", -v->mX * sx, -v->mX * sx, h);
+
+  const VPath *o = &j->fill;
+  if (o->nruns) {
+    fprintf(f, "q /Fill gs\n");
+    pdf_rgb(f, d_palette[o->col], "rg");
+    for (int r = 0; r < o->nruns; r++)
+      for (int k = o->run[r]; k < o->run[r + 1]; k++)
+        fprintf(f, "%.3f %.3f %s\n", o->pts[k].x, h - o->pts[k].y,
+                k == o->run[r] ? "m" : k + 1 < o->run[r + 1] ? "l" : "l h");
+    fprintf(f, "f\nQ\n");
+  }
+
+  fprintf(f, "%g w\n", d_line_width(h));
+  for (int c = 0; c < j->nc; c++) {
+    o = &j->c[c];
+    if (!o->nruns)
+      continue;
+    pdf_rgb(f, d_palette[o->col], "RG");
+    for (int r = 0; r < o->nruns; r++) {
+      int a = o->run[r], b = o->run[r + 1];
+      for (int k = a; k < b; k++)
+        fprintf(f, "%.3f %.3f %s\n", o->pts[k].x, h - o->pts[k].y,
+                k == a ? "m" : "l");
+      if (b - a == 1)
+        fprintf(f, "%.3f %.3f l\n", o->pts[a].x, h - o->pts[a].y);
+    }
+    fprintf(f, "S\n");
+  }
+}
+
+int export_pdf(const char *f_name, const PScene *s, int w, int h) {
+  if (w <= 0 || h <= 0)
+    return -1;
+  VJob j;
+  build(&j, s, w, h);
+  char *text = NULL;
+  size_t len = 0;
+  FILE *m = open_memstream(&text, &len);
+  if (m) {
+    pdf_content(m, &j);
+    if (fclose(m) != 0) {
+      free(text);
+      text = NULL;
+    }
+  }
+  unbuild(&j);
+  uLongf zlen = text ? compressBound(len) : 0;
+  unsigned char *z = text ? malloc(zlen) : NULL;
+  int ok = z && compress2(z, &zlen, (Bytef *)text, len, Z_BEST_SPEED) == Z_OK;
+  free(text);
+  FILE *f = ok ? fopen(f_name, "wb") : NULL;
+  if (!f) {
+    free(z);
+    return -1;
+  }
+
+  long off[5];
+  fprintf(f, "%%PDF-1.4\n");
+  off[1] = ftell(f);
+  fprintf(f, "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+  off[2] = ftell(f);
+  fprintf(f, "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+  off[3] = ftell(f);
+  fprintf(f,
+          "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %d %d] "
+          "/Contents 4 0 R /Resources << /ExtGState << /Fill << /ca %g >> "
+          ">> >> >>\nendobj\n",
+          w, h, fillAlpha);
+  off[4] = ftell(f);
+  fprintf(f, "4 0 obj\n<< /Length %lu /Filter /FlateDecode >>\nstream\n",
+          (unsigned long)zlen);
+  fwrite(z, 1, zlen, f);
+  fprintf(f, "\nendstream\nendobj\n");
+  long xref = ftell(f);
+  fprintf(f, "xref\n0 5\n0000000000 65535 f \n");
+  for (int i = 1; i < 5; i++)
+    fprintf(f, "%010ld 00000 n \n", off[i]);
+  fprintf(f, "trailer\n<< /Size 5 /Root 1 0 R >>\nstartxref\n%ld\n%%%%EOF\n",
+          xref);
+  free(z);
+  return ferror(f) | fclose(f) ? -1 : 0;
+}
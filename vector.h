@@ -0,0 +1,15 @@
+// Created by Unium on 18.10.26
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "types.h"
+
+// the plot of s as lines on a w x h page, the formulas of s compiled.
+// 0 when written
+int export_svg(const char *f_name, const PScene *s, int w, int h);
+int export_pdf(const char *f_name, const PScene *s, int w, int h);
+// how far the thinned curves may stray, in units of the page
+int d_vector_tolerance(double t);
+
+#endif // !VECTOR_H